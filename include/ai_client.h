@@ -1,17 +1,75 @@
-#ifndef __AI_CLIENT_H_
+#ifndef __AI_CLIENT_H__
 #define __AI_CLIENT_H__
 
+#include <stdint.h>
+#include <stdbool.h>
+
 /**
  * Create a file called "api_key.h" in directory "include",
  * and define your own API key as the macro "MY_API_KEY".
- * Or you can remove this line: #include "api_key.h" ,
- * and replace MY_API_KEY with your own api key simply.
+ * Or leave it out and pass the key at runtime instead
+ * (--ai-key or the AIC_API_KEY environment variable).
  */
+#if __has_include("api_key.h")
 #include "api_key.h"
+#endif
+#ifndef MY_API_KEY
+#define MY_API_KEY ""
+#endif
+
+// Compiled-in defaults, overridden by the AIC_URL / AIC_MODEL / AIC_API_KEY
+// environment variables, which are in turn overridden by aic_set_endpoint()
 #define AIC_API_KEY MY_API_KEY
 #define AIC_URL     "https://api.deepseek.com/chat/completions"
 #define AIC_MODEL   "deepseek-chat"
 
+// Number of long-lived curl handles kept for concurrent requests
+#define AIC_POOL_SIZE 4
+
+// Default number of batch requests kept in flight at once
+#define AIC_BATCH_INFLIGHT 8
+
+// Latency samples kept per command for the percentiles
+#define AIC_LATENCY_WINDOW 256
+// Hedging starts once a command has this many samples
+#define AIC_HEDGE_MIN_SAMPLES 20
+
+// Default prompt token budgets of the commands that send the task list
+// (0: unlimited). Larger lists are cut down to the most relevant tasks.
+#define AIC_SUGGEST_BUDGET 8000
+#define AIC_REPORT_BUDGET  8000
+// Chat history budget; older turns are folded into a summary beyond it
+#define AIC_CHAT_BUDGET    4000
+// Most recent chat turns that are never folded into the summary
+#define AIC_CHAT_KEEP_TURNS 2
+
+// Most tasks accepted from one 'task multi' answer
+#define AIC_MULTI_MAX 20
+
+// Response cache lifetimes, in seconds
+#define AIC_TTL_NONE    0   // never cached
+#define AIC_TTL_FOREVER (-1)
+
+// What a request is for; selects cache lifetime and other per-command policy
+typedef enum {
+  AIC_CMD_CHAT,
+  AIC_CMD_TASK_ADD,
+  AIC_CMD_TASK_MULTI,   // several tasks from one text, answered as a JSON array
+  AIC_CMD_TASK_UPDATE,
+  AIC_CMD_SUGGEST,
+  AIC_CMD_REPORT,
+  AIC_CMD_SUMMARY,      // compaction of the chat history
+  NR_AIC_CMD
+} aic_cmd_e;
+
+// Why a call returned no answer
+typedef enum {
+  AIC_OK,
+  AIC_ERR_NETWORK,    // unreachable, timed out or overloaded: worth sending again later
+  AIC_ERR_API,        // rejected by the API (key, request), or an unreadable response
+  AIC_ERR_ANSWER,     // answered, but the answer did not fit the command's schema
+} aic_error_e;
+
 extern char* answer;
 
 typedef struct MemoryStruct {
@@ -19,6 +77,143 @@ typedef struct MemoryStruct {
   size_t size;
 } MemoryStruct_t;
 
+// Per-phase durations of one HTTP request, in microseconds
+typedef struct {
+  int64_t dns_us;      // name resolution
+  int64_t connect_us;  // TCP handshake
+  int64_t tls_us;      // TLS handshake
+  int64_t ttfb_us;     // request sent -> first response byte
+  int64_t ttft_us;     // request start -> first content token (streaming only)
+  int64_t total_us;    // whole transfer
+  bool reused;         // an existing connection was reused
+  long prompt_tokens;  // "usage" of the answer, 0 if not reported
+  long cached_tokens;  // prompt tokens served from the server's prefix cache
+  long completion_tokens;
+} aic_timing_t;
+
+// Receives each piece of answer text as it arrives
+typedef void (*aic_token_cb)(const char *token, size_t len, void *userp);
+
+// Receives the answer of batch item index (NULL on failure); the callee owns answer
+typedef void (*aic_batch_cb)(int index, char *answer, void *userp);
+
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t stores;
+  uint64_t evictions;
+  int entries;         // live entries in the index
+  size_t bytes;        // live payload bytes
+} aic_cache_stats_t;
+
+// How "task add" inputs were served: parsed locally or by the model
+typedef struct {
+  uint64_t local;      // parsed locally
+  uint64_t fallback;   // handed to the model by the local parser
+  int64_t local_us;    // total time spent in the local parser
+  uint64_t remote;     // task add round trips to the model
+  int64_t remote_us;   // total time of those round trips
+} aic_local_stats_t;
+
+// Timeouts, retries and hedging of AI requests
+typedef struct {
+  long connect_timeout_ms;  // TCP + TLS handshake
+  long timeout_ms;          // whole request
+  long stall_ms;            // abort when no byte arrives for this long
+  int max_retries;          // extra attempts after a retryable failure
+  long backoff_base_ms;     // first retry waits up to this long
+  long backoff_max_ms;      // cap of the exponential backoff
+  bool hedge;               // duplicate requests with no first byte within the p95
+} aic_policy_t;
+
+// Latency percentiles of one command over the last AIC_LATENCY_WINDOW successful requests
+typedef struct {
+  int samples;
+  int64_t p50_us, p95_us, p99_us;                  // whole request
+  int64_t first_p50_us, first_p95_us, first_p99_us;  // first response byte
+  uint64_t requests;    // round trips started (retries and hedges included)
+  uint64_t failures;    // round trips that produced no answer
+  uint64_t retries;
+  uint64_t hedges;      // duplicate requests fired
+  uint64_t hedge_wins;  // ... that answered first
+  uint64_t coalesced;   // calls that shared an identical request already in flight
+} aic_latency_t;
+
+// Model, endpoint and request parameters a command is routed to
+typedef struct {
+  const char *url;
+  const char *model;
+  long max_tokens;      // 0: the server's default
+  double temperature;   // negative: the server's default
+  long timeout_ms;      // total timeout of its requests
+  bool json_mode;       // asks the server for a JSON object answer
+} aic_route_info_t;
+
+/**
+ * How the JSON answers of one command (task add/multi/update) held up against
+ * the task schema. Corrections over answers is the re-prompt rate.
+ */
+typedef struct {
+  uint64_t answers;      // answers checked (cache hits excluded)
+  uint64_t clean;        // just the JSON, valid as sent
+  uint64_t extracted;    // valid once the prose or code fences around it were dropped
+  uint64_t corrections;  // re-prompts after a schema failure
+  uint64_t corrected;    // ... that produced a valid answer
+  uint64_t failed;       // answers given up on
+} aic_json_stats_t;
+
+// Encodings of task data embedded in prompts
+typedef enum {
+  AIC_FORMAT_JSON,      // compact JSON
+  AIC_FORMAT_TABLE,     // header row + one '|'-separated row per task, relative times
+} aic_format_e;
+
+/**
+ * Local prompt token estimates against the "usage" the API reported, and how
+ * much of the prompts the server's prefix cache served.
+ */
+typedef struct {
+  uint64_t requests;            // answers that came with usage
+  uint64_t estimated;           // sum of the estimates of those requests
+  uint64_t prompt_tokens;       // sum of usage.prompt_tokens
+  uint64_t completion_tokens;   // sum of usage.completion_tokens
+  uint64_t cache_hit_tokens;    // prompt tokens read from the prefix cache
+  uint64_t cache_miss_tokens;
+  uint64_t cached_requests;     // requests with at least one cache hit token
+  uint64_t cached_first_byte_us;    // summed time to first byte of those requests
+  uint64_t uncached_first_byte_us;  // ... and of the others
+} aic_token_stats_t;
+
+/**
+ * A prompt assembled from pieces (a rope). Pieces are JSON-escaped while the
+ * request body is streamed to the server, so a large task dump is never copied
+ * into a prompt buffer or a request buffer.
+ */
+typedef struct aic_prompt aic_prompt_t;
+
+aic_prompt_t *aic_prompt_new(void);
+// Borrowed piece: must stay valid until the prompt is freed
+void aic_prompt_add(aic_prompt_t *p, const char *str);
+// Owned piece: freed with the prompt
+void aic_prompt_add_owned(aic_prompt_t *p, char *str);
+// Small formatted piece
+void aic_prompt_addf(aic_prompt_t *p, const char *fmt, ...);
+// One-piece prompt owning str (NULL if str is NULL)
+aic_prompt_t *aic_prompt_wrap(char *str);
+size_t aic_prompt_len(const aic_prompt_t *p);
+// Concatenated copy, for callers that need a flat string; the caller frees it
+char *aic_prompt_flatten(const aic_prompt_t *p);
+void aic_prompt_free(aic_prompt_t *p);
+
+/**
+ * @brief Estimates the token count of text without a tokenizer.
+ * * ASCII words count about four letters per token, numbers three digits;
+ *   every CJK character counts as one token. Off by some 10-20% either way,
+ *   which is enough to keep prompts within a budget.
+ */
+size_t aic_estimate_tokens(const char *text, size_t len);
+size_t aic_prompt_tokens(const aic_prompt_t *p);
+
 /**
  * @brief  Initializes the AI client and required libraries.
  * @return 0 on success; exits the program on failure.
@@ -34,10 +229,193 @@ int aic_init(void);
  */
 char* aic_call(const char *prompt);
 
+/**
+ * @brief Same as aic_call(), tagged with the command the request serves.
+ * * Identical requests are answered from the response cache while the
+ *   command's TTL allows it.
+ */
+char* aic_call_cmd(aic_cmd_e cmd, const char *prompt);
+
+/**
+ * @brief Same as aic_call_cmd(), reporting the answer incrementally.
+ * * With streaming enabled, on_token is called for every content delta as the
+ *   server sends it; otherwise (and on cache hits) it is called once with the
+ *   whole answer. The complete answer is still returned.
+ * @param on_token Token callback, may be NULL.
+ */
+char* aic_call_stream(aic_cmd_e cmd, const char *prompt, aic_token_cb on_token, void *userp);
+
+/**
+ * @brief Same as aic_call_stream() for a prompt rope.
+ * * The request body is produced piece by piece while curl sends it, so the
+ *   memory of a call is the prompt itself plus a fixed-size buffer.
+ */
+char* aic_call_prompt(aic_cmd_e cmd, const aic_prompt_t *prompt, aic_token_cb on_token, void *userp);
+
+/**
+ * @brief Why the last aic_call*() on the calling thread returned NULL.
+ */
+aic_error_e aic_last_error(void);
+
+/**
+ * @brief Timing and usage of the last aic_call*() on the calling thread; all zero
+ *        if it was answered from the cache or by an identical request in flight.
+ */
+void aic_get_call_timing(aic_timing_t *timing);
+
+/**
+ * @brief Sends count independent requests concurrently.
+ * * At most max_inflight requests are on the wire at once. Answers are handed
+ *   to on_result strictly in input order, each as soon as it and every answer
+ *   before it have completed.
+ * @return Number of requests that produced an answer.
+ */
+int aic_call_batch(aic_cmd_e cmd, char *const prompts[], int count, int max_inflight,
+    aic_batch_cb on_result, void *userp);
+
+/**
+ * @brief Points the client at another chat-completions endpoint.
+ * * Must be called before aic_init(). NULL arguments keep the environment or
+ *   compiled-in value. The strings are not copied.
+ * @return 0 on success, -1 if the client is already initialized.
+ */
+int aic_set_endpoint(const char *url, const char *model, const char *api_key);
+const char *aic_get_url(void);
+const char *aic_get_model(void);
+
+/**
+ * @brief Loads the per-command routing table from an INI-style file.
+ * * One [command] section per command to route ("task add", "report", ...;
+ *   "*" for all of them) with url, model, api_key, max_tokens, temperature,
+ *   timeout_ms and json_mode (on/off; on by default for task add and update).
+ *   Unset values fall back to the "*" section, then to the endpoint of
+ *   aic_set_endpoint(). Without path, AIC_ROUTES names the file.
+ *   Must be called before aic_init().
+ * @return 0 on success (or no file), -1 if the file could not be read or had
+ *         invalid lines, which are skipped.
+ */
+int aic_load_routes(const char *path);
+void aic_get_route(aic_cmd_e cmd, aic_route_info_t *route);
+
+void aic_set_policy(const aic_policy_t *policy);
+void aic_get_policy(aic_policy_t *policy);
+
+/**
+ * @brief Latency percentiles and retry/hedge counters of one command.
+ */
+void aic_get_latency(aic_cmd_e cmd, aic_latency_t *lat);
+
+/**
+ * @brief Schema checks of the JSON answers of one command.
+ * * Answers of task add, multi and update are cut down to their first valid
+ *   JSON value and checked against the task schema before they are returned,
+ *   cached or shared. Only a schema failure costs a round trip: one
+ *   re-prompt naming the problem. An answer that still fails comes back NULL.
+ */
+void aic_get_json_stats(aic_cmd_e cmd, aic_json_stats_t *st);
+const char *aic_cmd_name(aic_cmd_e cmd);
+
+/**
+ * @brief Prompt token budget of a command; 0 means unlimited.
+ */
+void aic_set_token_budget(aic_cmd_e cmd, size_t tokens);
+size_t aic_get_token_budget(aic_cmd_e cmd);
+
+/**
+ * @brief Tokens left for a command's data (task list, report statistics) once
+ *        its prompt template and the request overhead are counted.
+ * @return The data budget, or 0 if the command's budget is unlimited.
+ */
+size_t aic_data_budget(aic_cmd_e cmd);
+
+/**
+ * @brief Estimated versus actual prompt tokens of one command.
+ */
+void aic_get_token_stats(aic_cmd_e cmd, aic_token_stats_t *st);
+
+/**
+ * @brief Enables or disables server-sent event streaming (enabled by default).
+ */
+void aic_set_streaming(bool enable);
+
+/**
+ * @brief Enables the on-disk response cache stored at path.
+ * @return 0 on success, -1 if the cache could not be opened (requests still work).
+ */
+int aic_cache_init(const char *path);
+void aic_get_cache_stats(aic_cache_stats_t *stats);
+
+/**
+ * @brief Parses a formulaic task description without calling the model.
+ * @return The task JSON (same shape as the model's answer), or NULL if the
+ *         input is not understood with confidence and should go to the model.
+ *         The caller frees the string.
+ */
+char* aic_task_add_local(const char *task_input);
+void aic_set_local_parse(bool enable);
+void aic_get_local_stats(aic_local_stats_t *stats);
+
+/**
+ * @brief Static instructions of a command, sent as its system message.
+ * * They never change between calls, so every request of a command shares a
+ *   long identical prefix the server can cache; the prompt builders below
+ *   only produce the per-call user message.
+ */
+const char *aic_system_prompt(aic_cmd_e cmd);
+
 char* aic_task_add_prompt(const char *task_input);
+// User message asking for every task in task_input as one JSON array
+char* aic_task_multi_prompt(const char *task_input);
 char* aic_task_update_prompt(const char *current_task_json, const char *instruction, time_t created_at);
-char* aic_task_suggest_prompt(const char *task_list_json);
-char* aic_report_prompt(const char *task_list_json, const char *report_type);
+/**
+ * @brief Encoding of the task data a command's prompt template embeds.
+ * * Suggest and report use the compact table (about half the tokens of JSON);
+ *   task update keeps JSON because the model answers with the edited object.
+ */
+aic_format_e aic_template_format(aic_cmd_e cmd);
+void aic_set_template_format(aic_cmd_e cmd, aic_format_e format);
+
+// These two take ownership of the data string (encoded as aic_template_format()
+// says), which becomes a rope piece
+aic_prompt_t* aic_task_suggest_prompt(char *task_list);
+aic_prompt_t* aic_report_prompt(char *report_data, const char *report_type);
+
+/**
+ * A chat session: the conversation is resent with every message, within the
+ * AIC_CMD_CHAT token budget. Beyond it the oldest turns (all but the last
+ * AIC_CHAT_KEEP_TURNS) are folded into a summary kept here, written by the
+ * model or, if that fails, made of the start of each turn. Not thread-safe.
+ */
+typedef struct aic_chat aic_chat_t;
+
+typedef struct {
+  int turns;              // turns kept verbatim
+  int compactions;        // times older turns were folded into the summary
+  size_t summary_tokens;  // estimated
+  size_t history_tokens;  // summary + kept turns, estimated
+} aic_chat_stats_t;
+
+aic_chat_t *aic_chat_new(void);
+void aic_chat_free(aic_chat_t *chat);
+// Drops the whole history
+void aic_chat_forget(aic_chat_t *chat);
+/**
+ * @brief Builds the request for the next message: summary, kept turns, input.
+ * * Compacts the history first (one summary request) if it would not fit.
+ */
+aic_prompt_t *aic_chat_prompt(aic_chat_t *chat, const char *input);
+// Appends an answered turn
+void aic_chat_commit(aic_chat_t *chat, const char *input, const char *answer);
+void aic_chat_get_stats(const aic_chat_t *chat, aic_chat_stats_t *st);
+const char *aic_chat_summary(const aic_chat_t *chat);
+// Turn i (oldest first); returns -1 past the last one
+int aic_chat_turn(const aic_chat_t *chat, int i, const char **user, const char **answer);
+
+/**
+ * @brief Copies the phase timing (and token usage) of the most recent request,
+ *        on any thread. Use aic_get_call_timing() for the caller's own request.
+ */
+void aic_get_last_timing(aic_timing_t *timing);
 
 /**
  * @brief Releases all resources used by the AI client.
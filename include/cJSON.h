@@ -120,6 +120,9 @@ typedef struct cJSON
 
     /* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
     char *string;
+
+    /* Key index of a parsed object's children. Owned by cJSON, do not touch. */
+    struct cJSON_KeyIndex *keyindex;
 } cJSON;
 
 typedef struct cJSON_Hooks
@@ -143,6 +146,16 @@ typedef int cJSON_bool;
 #define CJSON_CIRCULAR_LIMIT 10000
 #endif
 
+/* Parsed objects with at least this many children get a hashed key index.
+ * Smaller objects, and objects edited after parsing, are searched linearly.
+ * Define as 0 to disable the index entirely.
+ * Lookups (cJSON_GetObjectItem*, cJSON_HasObjectItem) never write to the tree, so
+ * several threads may look up keys in a shared tree at the same time. They are not
+ * thread-safe against any thread that edits it (add, delete, replace, detach). */
+#ifndef CJSON_KEY_INDEX_MIN_ITEMS
+#define CJSON_KEY_INDEX_MIN_ITEMS 8
+#endif
+
 /* returns the version of cJSON as a string */
 CJSON_PUBLIC(const char*) cJSON_Version(void);
 
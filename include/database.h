@@ -113,6 +113,17 @@ void db_shutdown(void);
  */
 int db_add_task(const char *task_json);
 
+/**
+ * @brief Adds a batch of already parsed tasks.
+ * * Reuses free blocks first, then appends the rest as one contiguous block
+ *   written with a single I/O call. IDs are assigned and stored back into tasks.
+ * @param tasks Array of tasks; the id field is ignored on input.
+ * @param count Number of tasks in the array.
+ * @return int Number of tasks actually added (stops early when the index is full),
+ *             or -1 if an I/O error occurred before any task was added.
+ */
+int db_add_tasks(task_t *tasks, int count);
+
 /**
  * @brief Finds a single task by its unique ID.
  * * Reads the record directly from the file into the result buffer.
@@ -122,6 +133,13 @@ int db_add_task(const char *task_json);
  */
 int db_find_task_by_id(int id, task_t *result_task);
 
+/**
+ * @brief Finds a task with the same title, description and due date created at or after since.
+ * * Used to skip a task that a replayed request already added.
+ * @return int ID of the first match, 0 if there is none.
+ */
+int db_find_same_task(const task_t *task, time_t since);
+
 /**
  * @brief Updates an existing task's full record in the database file.
  * * Uses the ID in updated_task to find the offset and overwrite the block.
@@ -160,4 +178,131 @@ void db_print_all_task();
 void db_print_header();
 char* db_get_all_tasks_json(void);
 
+/**
+ * @brief Cost of one task's JSON fragment in the caller's unit (e.g. tokens).
+ */
+typedef size_t (*db_cost_fn)(const char *json, size_t len);
+
+/**
+ * @brief Encodings of a task list.
+ */
+typedef enum {
+    DB_FORMAT_JSON,     // Compact JSON array, same as db_get_all_tasks_json().
+    DB_FORMAT_TABLE,    // Header row plus one '|'-separated row per task (psr_task_to_row()).
+} db_format_e;
+
+/**
+ * @brief Returns the task list in the given format, cut down to fit in budget.
+ * * If every task fits, tasks are listed in index order (for JSON the result then
+ *   equals db_get_all_tasks_json()). Otherwise tasks are taken in relevance order
+ *   until the next one would exceed the budget: open tasks in scheduler order
+ *   (soon due, high priority, waiting longest), then completed tasks, most
+ *   recently completed first.
+ * @param now Reference time of the relative times in DB_FORMAT_TABLE.
+ * @param budget Maximum total cost; 0 (or a NULL cost) means unlimited.
+ * @param nr_included Optional; receives the number of tasks listed.
+ * @param nr_total Optional; receives the number of tasks in the database.
+ * @return char* Dynamically allocated string, or NULL on failure.
+ */
+char* db_get_task_list_within(db_format_e format, time_t now, size_t budget, db_cost_fn cost,
+                              int *nr_included, int *nr_total);
+
+/**
+ * @brief Parallel variant of db_get_all_tasks_json().
+ * * Splits the index into chunks that worker threads serialize into private buffers,
+ *   then joins them with one final copy. Must not run concurrently with writers.
+ * @param nr_threads Number of worker threads (1 serializes on the calling thread).
+ * @return char* Dynamically allocated JSON array string, or NULL on failure.
+ */
+char* db_get_all_tasks_json_parallel(int nr_threads);
+
+/**
+ * @brief Sets the thread count db_get_all_tasks_json() uses (default 1).
+ * * Threads are started per call, and only when enough tasks are missing from the
+ *   JSON cache to pay for them (see JSON_PARALLEL_MIN_MISSES in database.c).
+ */
+void db_set_json_threads(int nr_threads);
+int db_get_json_threads(void);
+
+/**
+ * @brief Drops every cached task JSON fragment (used to benchmark cold serialization).
+ */
+void db_drop_json_cache(void);
+
+// --- NEXT-TASK SCHEDULER ---
+
+/**
+ * @brief Weights of the local "what next" score (lower score = do it first).
+ * * score = due_weight * (due - now) - age_weight * (now - created_at)
+ *         + prio * prio_hours * 3600
+ *   Tasks without a due date count as due one week after creation.
+ */
+typedef struct {
+    double prio_hours;      // Hours of due-date slack one priority level is worth.
+    double due_weight;      // Weight of the time left until due_date.
+    double age_weight;      // Weight of the time since created_at.
+} db_sched_weights_t;
+
+void db_set_sched_weights(const db_sched_weights_t *weights);
+void db_get_sched_weights(db_sched_weights_t *weights);
+
+/**
+ * @brief Returns the n open (TODO/DOING) tasks with the best score, best first.
+ * * The heap is maintained by the CRUD functions, so this does not scan the index.
+ * @return int Number of tasks written to out, or -1 on error.
+ */
+int db_next_tasks(int n, task_t *out);
+
+// --- REPORT AGGREGATION ---
+
+#define REPORT_MAX_LISTED 10    // Max tasks listed per report section.
+
+/**
+ * @brief Statistics of one reporting period, computed in a single pass over the index.
+ * * The task lists are capped at REPORT_MAX_LISTED entries, so the size of the
+ *   report does not depend on the size of the database.
+ */
+typedef struct {
+    time_t now;
+    time_t window_start;            // Start of the reporting period.
+    int total;                      // Tasks that are not deleted.
+    int by_status[TASK_STATUS_DELETED];   // TODO / DOING / DONE counts.
+    int by_prio[PRIORITY_LOW + 1];  // Priority distribution of non-deleted tasks.
+    int open_by_prio[PRIORITY_LOW + 1];   // Same, for tasks still TODO/DOING.
+    int created;                    // Created within the period.
+    int completed;                  // Completed within the period.
+    int overdue;                    // Open tasks whose due date has passed.
+    int pending_critical;           // Open URGENT/IMPORTANT tasks.
+
+    int nr_completed_list;          // Most recent completions in the period.
+    task_t completed_list[REPORT_MAX_LISTED];
+    int nr_critical_list;           // Open URGENT/IMPORTANT tasks, earliest due first.
+    task_t critical_list[REPORT_MAX_LISTED];
+    int nr_overdue_list;            // Overdue tasks, longest overdue first.
+    task_t overdue_list[REPORT_MAX_LISTED];
+} db_report_t;
+
+/**
+ * @brief Aggregates the statistics of the last window_days days.
+ * @param now Reference time (end of the period).
+ * @return int 0 on success, -1 on invalid arguments.
+ */
+int db_build_report(time_t now, int window_days, db_report_t *report);
+
+// --- BULK IMPORT/EXPORT ---
+
+/**
+ * @brief Streams all tasks to a newline-delimited JSON file, one compact object per line.
+ * @return int Number of tasks written, or -1 on failure.
+ */
+int db_export_ndjson(const char *path);
+
+/**
+ * @brief Streams tasks from a newline-delimited JSON file into the database.
+ * * Memory use is bounded by one read buffer and one insert batch regardless of file size.
+ *   Malformed lines are skipped and counted. IDs in the file are ignored and reassigned.
+ * @return int Number of tasks imported, or -1 if the file could not be read.
+ */
+int db_import_ndjson(const char *path);
+
 #endif
\ No newline at end of file
@@ -15,6 +15,37 @@
  */
 int psr_json_to_task(const char *task_json, task_t *task_out, int require_id);
 
+/**
+ * @brief 解析新任务的 JSON 数组（一次 AI 调用提取出的多个任务）。
+ * * 每个元素按 psr_json_to_task(..., 0) 的规则校验；任一元素无效时整体失败，
+ *   不会只添加其中一部分。单个 JSON 对象按一个任务处理。
+ * @param tasks_out 成功时指向 malloc 的任务数组，调用者负责 free()。
+ * @param max_count 允许的最大任务数。
+ * @return int 任务数 (>= 1)，失败返回 -1。
+ */
+int psr_json_to_tasks(const char *tasks_json, task_t **tasks_out, int max_count);
+
+/**
+ * @brief 按 task_t 模式严格校验模型给出的任务 JSON，比 psr_json_to_task() 更严格：
+ *        字段类型与取值范围不符时报错，而不是静默使用默认值。
+ * @param require_id 为 1 时要求有效的 "id"（更新），否则要求非空 "title"（新建）。
+ * @param err 失败时写入英文的简短原因，可直接用于给模型的纠正提示。
+ * @return int 0 表示符合模式，-1 表示不符合。
+ */
+int psr_check_task(const char *task_json, int require_id, char *err, size_t err_len);
+
+/**
+ * @brief 同 psr_check_task()，校验 1 到 max_count 个新任务组成的数组（单个对象视为一个元素）。
+ */
+int psr_check_tasks(const char *tasks_json, int max_count, char *err, size_t err_len);
+
+/**
+ * @brief 解析导出文件中的单个任务 JSON，保留 status/created_at/completed_at。
+ * * "id" 字段被忽略，导入时由数据库重新分配。
+ * @return int 0 on success, -1 on failure.
+ */
+int psr_json_to_task_import(const char *task_json, task_t *task_out);
+
 /**
  * @brief 将 task_t 结构体序列化为 JSON 字符串。
  * @param task_in 指向要序列化的 task_t 结构体指针。
@@ -23,6 +54,47 @@ int psr_json_to_task(const char *task_json, task_t *task_out, int require_id);
  */
 char* psr_task_to_json(const task_t *task_in);
 
+/**
+ * @brief 将 task_t 结构体序列化为紧凑格式（无缩进、无换行）的 JSON 字符串。
+ * @param task_in 指向要序列化的 task_t 结构体指针。
+ * @return char* 包含 JSON 数据的字符串指针，调用者负责 free()。
+ */
+char* psr_task_to_json_unformatted(const task_t *task_in);
+
+/**
+ * @brief 将报表统计序列化为紧凑 JSON，供报表提示词使用。
+ * @param report_type 报表类型字符串，例如 "WEEKLY"。
+ * @return char* JSON 字符串，调用者负责 free()。
+ */
+char* psr_report_to_json(const db_report_t *report, const char *report_type);
+
+// --- 提示词用的紧凑表格编码 ---
+
+/**
+ * @brief 任务表格的表头行（不含换行），与 psr_task_to_row() 的字段一一对应。
+ */
+const char* psr_task_table_header(void);
+
+/**
+ * @brief 将任务编码为一行表格（不含换行），比 JSON 节省大量 token。
+ * * 字段以 '|' 分隔；时间为相对 now 的小时/天数 (例如 "+3d"、"-5h")；状态和优先级用名称；
+ *   空字段留空，行尾的空字段省略。标题和描述中的 '|' 与换行会被替换。
+ * @return char* 行字符串，调用者负责 free()。
+ */
+char* psr_task_to_row(const task_t *task, time_t now);
+
+/**
+ * @brief 将报表统计编码为紧凑文本：计数为 key=value 行，任务列表为表格。
+ * * 字段名与 psr_report_to_json() 相同，时间相对 report->now。
+ * @return char* 文本字符串，调用者负责 free()。
+ */
+char* psr_report_to_table(const db_report_t *report, const char *report_type);
+
+/**
+ * @brief 将时间戳编码为相对 now 的时间：一天以内为小时 ("+5h")，否则为天 ("-3d")；0 编码为空串。
+ */
+void psr_relative_time(time_t timestamp, time_t now, char *buffer, size_t buffer_size);
+
 /**
  * @brief 将 time_t 时间戳转换为人类可读的字符串格式。
  * @param timestamp 要转换的时间戳。
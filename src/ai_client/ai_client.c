@@ -1,6 +1,18 @@
 #include <curl/curl.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 #include "common.h"
 #include "ai_client.h"
+#include "response_cache.h"
+#include "sse.h"
+#include "local_parser.h"
+#include "latency.h"
+#include "rope.h"
+#include "tokens.h"
+#include "json_reply.h"
+#include "parser.h"
 #include "cJSON.h" 
 
 char *answer = NULL;
@@ -8,12 +20,100 @@ char *answer = NULL;
 // --- Internal Functions ---
 
 static bool is_initialized = false;
+static bool stream_enabled = true;
+
+// Endpoint in use; resolved by aic_init()
+static const char *aic_url = NULL;
+static const char *aic_model = NULL;
+static const char *aic_api_key = NULL;
+
+static aic_policy_t policy = {
+  .connect_timeout_ms = 10 * 1000,
+  .timeout_ms         = 5 * 60 * 1000,  // long streamed reports stay well within this
+  .stall_ms           = 30 * 1000,
+  .max_retries        = 2,
+  .backoff_base_ms    = 500,
+  .backoff_max_ms     = 8 * 1000,
+  .hedge              = false,
+};
+
+// State of one in-flight request
+typedef struct aic_request {
+  MemoryStruct_t raw;    // response body (non-SSE bodies only, e.g. API errors)
+  bool stream;
+  sse_parser_t sse;
+  int64_t start_us;
+  int64_t first_byte_us;
+  int64_t first_token_us;
+  struct aic_request **winner;  // hedged calls: the attempt whose data is kept
+  rope_body_t body;      // read position in a streamed request body
+  tok_usage_t usage;     // "usage" reported with the answer, zero if none
+} aic_request_t;
+
+// Where and how the requests of one command are sent. Settings the routes
+// file leaves out fall back to its "*" section, then to the global endpoint.
+typedef struct {
+  char *url;
+  char *model;
+  char *api_key;
+  long max_tokens;          // 0: the server's default
+  double temperature;       // only sent if has_temperature
+  bool has_temperature;
+  long timeout_ms;          // 0: the policy's total timeout
+  bool json_mode;           // ask for a JSON object ("response_format")
+  bool has_json_mode;
+  // Built by aic_init(). The head is the request JSON up to the escaped user
+  // prompt: the model and the command's system message never change, so every
+  // request of a command starts with the same bytes and the server can reuse
+  // its cached prefix.
+  char *head;
+  char *tail[2];            // after the prompt: [0] plain, [1] streamed
+  struct curl_slist *headers;
+  size_t system_tokens;
+} route_t;
+
+// One route per command, plus the "*" section of the routes file
+static route_t routes[NR_AIC_CMD + 1];
+#define ANY_ROUTE NR_AIC_CMD
+
+// Request body: a flat JSON string, or a prompt rope streamed through the
+// read callback (json == NULL) with its length known up front
+typedef struct {
+  const char *json;
+  rope_body_t rope;
+  curl_off_t len;
+  const route_t *route;
+} aic_body_t;
+
+static int64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
 // Receives and records the data from libcurl
 static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp) {
   size_t realsize = size * nmemb;
-  MemoryStruct_t *mem = (MemoryStruct_t *)userp;
+  aic_request_t *req = (aic_request_t *)userp;
+
+  if (req->first_byte_us == 0) req->first_byte_us = now_us();
+  if (req->winner) {
+    // The first attempt of a hedged call to send data is the one that is kept
+    if (*req->winner == NULL) *req->winner = req;
+    if (*req->winner != req) return 0;
+  }
+
+  if (req->stream) {
+    // Decode events as they arrive so tokens can be shown immediately
+    if (sse_feed(&req->sse, contents, realsize) != 0) return 0;
+    if (req->first_token_us == 0 && req->sse.nr_tokens > 0) {
+      req->first_token_us = now_us();
+    }
+    // Once the body is known to be an event stream there is no need to keep it
+    if (req->sse.nr_events > 0) return realsize;
+  }
 
+  MemoryStruct_t *mem = &req->raw;
   char *ptr = realloc(mem->memory, mem->size + realsize + 1);
   if (ptr == NULL) {
     // Handle memory allocation error
@@ -28,158 +128,1372 @@ static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *use
   return realsize;
 }
 
-// Creates request JSON
-static char* create_request_json(const char* prompt) {
-  cJSON *root = cJSON_CreateObject();
-  cJSON *messages = cJSON_CreateArray();
-  char *json_string = NULL;
+// Supplies the next part of a streamed request body to libcurl
+static size_t ReadCallback(char *buffer, size_t size, size_t nitems, void *userp) {
+  return rope_body_read((rope_body_t *)userp, buffer, size * nitems);
+}
 
-  if (!root || !messages) goto end;
+// libcurl rewinds the body when it has to resend it (redirects, HTTP/2 retries)
+static int SeekCallback(void *userp, curl_off_t offset, int origin) {
+  if (origin != SEEK_SET || offset != 0) return CURL_SEEKFUNC_CANTSEEK;
+  rope_body_rewind((rope_body_t *)userp);
+  return CURL_SEEKFUNC_OK;
+}
 
-  cJSON_AddStringToObject(root, "model", AIC_MODEL);
+// Extracts choices[0].message.content (and usage) from a complete (non-streamed) response
+static char *parse_response(const char *raw, aic_request_t *req) {
+  cJSON *response_json = cJSON_Parse(raw);
+  cJSON *choices, *first_choice, *message, *content;
+  char *ai_response = NULL;
   
-  // System role
-  cJSON *sys_msg = cJSON_CreateObject();
-  cJSON_AddStringToObject(sys_msg, "role", "system");
-  cJSON_AddStringToObject(sys_msg, "content", "You are a helpful assistant.");
-  cJSON_AddItemToArray(messages, sys_msg);
+  if (!response_json) {
+    Log(ANSI_FMT("Failed to parse JSON response. Raw: %s",
+      ANSI_FG_RED), raw);
+    goto json_cleanup;
+  }
+  tok_read_usage(response_json, &req->usage);
+  
+  choices = cJSON_GetObjectItemCaseSensitive(response_json, "choices");
+  if (!choices) {
+    Log(ANSI_FMT("JSON structure error: Missing 'choices'. Raw: %s",
+      ANSI_FG_RED), raw);
+    goto json_cleanup;
+  }
 
-  // User role
-  cJSON *user_msg = cJSON_CreateObject();
-  cJSON_AddStringToObject(user_msg, "role", "user");
-  cJSON_AddStringToObject(user_msg, "content", prompt);
-  cJSON_AddItemToArray(messages, user_msg);
+  first_choice = cJSON_GetArrayItem(choices, 0);
+  if (!first_choice) {
+    Log(ANSI_FMT("JSON structure error: Missing first choice item. Raw: %s",
+      ANSI_FG_RED), raw);
+    goto json_cleanup;
+  }
 
-  cJSON_AddItemToObject(root, "messages", messages);
-  cJSON_AddFalseToObject(root, "stream");
+  message = cJSON_GetObjectItemCaseSensitive(first_choice, "message");
+  if (!message) {
+    Log(ANSI_FMT("JSON structure error: Missing 'message'. Raw: %s", ANSI_FG_RED), raw);
+    goto json_cleanup;
+  }
 
-  json_string = cJSON_PrintUnformatted(root);
+  content = cJSON_GetObjectItemCaseSensitive(message, "content");
+  
+  if (cJSON_IsString(content) && content->valuestring != NULL) {
+    // Duplicate the string so that cJSON_Delete doesn't free it
+    ai_response = strdup(content->valuestring);
+    if (!ai_response) { panic("Memory allocation failed for ai_response."); }
+  } else {
+    // Likely API error message in the response
+    Log(ANSI_FMT("API error or content extraction failed. Full response:\n%s",
+      ANSI_FG_RED), raw);
+  }
+
+json_cleanup:
+  cJSON_Delete(response_json);
+  return ai_response;
+}
 
-end:
-  cJSON_Delete(root);
+// Flat request JSON of a batch item (never streamed). Cache keys are taken
+// over the plain body on every path, so batch and streamed requests share entries.
+static char* create_request_json(const route_t *route, const char* prompt) {
+  char *content = rope_escape(prompt);
+  if (!content) return NULL;
+
+  size_t len = strlen(route->head) + strlen(content) + strlen(route->tail[0]) + 1;
+  char *json_string = malloc(len);
+  if (json_string) snprintf(json_string, len, "%s%s%s", route->head, content, route->tail[0]);
+  free(content);
   return json_string; // Must be freed by the caller
 }
 
+// Flat request JSON of a prompt rope (never streamed), for a batch correction
+static char *rope_request_json(const route_t *route, const aic_prompt_t *prompt) {
+  rope_body_t rope;
+  size_t len = 0, size = 4096, n;
+  char *json = malloc(size);
+
+  rope_body_init(&rope, prompt, route->head, route->tail[0]);
+  while (json && (n = rope_body_read(&rope, json + len, size - len - 1)) > 0) {
+    len += n;
+    if (len + 1 == size) {
+      char *p = realloc(json, size *= 2);
+      if (!p) free(json);
+      json = p;
+    }
+  }
+  if (json) json[len] = '\0';
+  return json; // Must be freed by the caller
+}
+
+// Long-lived easy handles. Connections, DNS results and TLS sessions
+// are shared between them, so only the first request pays the handshakes.
+typedef struct {
+  CURL *curl;
+  bool busy;
+} aic_handle_t;
+
+static aic_handle_t handle_pool[AIC_POOL_SIZE];
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+
+static CURLSH *share = NULL;
+static pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+
+static aic_timing_t last_timing;
+
+// A request on the wire that identical concurrent calls wait for instead of
+// sending their own (single flight). Freed by whoever drops the last reference.
+typedef struct inflight {
+  uint64_t key[2];      // same as the response cache key: endpoint + body
+  char *answer;         // NULL if the request failed
+  aic_error_e error;    // ... and why
+  bool done;
+  int refs;             // the caller performing the request + its waiters
+  struct inflight *next;
+} inflight_t;
+
+static inflight_t *inflight_list = NULL;
+static pthread_mutex_t inflight_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t inflight_cond = PTHREAD_COND_INITIALIZER;
+
+// Why the last call on this thread produced no answer
+static __thread aic_error_e last_error = AIC_OK;
+// Timing and usage of the last round trip on this thread
+static __thread aic_timing_t call_timing;
+
+static bool local_parse_enabled = true;
+static aic_local_stats_t local_stats;
+static pthread_mutex_t local_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// How long a cached answer stays valid for each command. Reports and
+// suggestions describe a moving task list; parses of a fixed input do not age.
+static const long cmd_ttl[NR_AIC_CMD] = {
+  [AIC_CMD_CHAT]        = AIC_TTL_NONE,
+  [AIC_CMD_TASK_ADD]    = AIC_TTL_FOREVER,
+  [AIC_CMD_TASK_MULTI]  = AIC_TTL_FOREVER,
+  [AIC_CMD_TASK_UPDATE] = AIC_TTL_FOREVER,
+  [AIC_CMD_SUGGEST]     = 10 * 60,
+  [AIC_CMD_REPORT]      = 60 * 60,
+  [AIC_CMD_SUMMARY]     = AIC_TTL_NONE,
+};
+
+// Schema of the commands that answer with task JSON; NULL for free text
+typedef int (*schema_check_t)(const char *json, char *err, size_t err_len);
+
+static int check_new_task(const char *json, char *err, size_t err_len) {
+  return psr_check_task(json, 0, err, err_len);
+}
+
+static int check_updated_task(const char *json, char *err, size_t err_len) {
+  return psr_check_task(json, 1, err, err_len);
+}
+
+static int check_new_tasks(const char *json, char *err, size_t err_len) {
+  return psr_check_tasks(json, AIC_MULTI_MAX, err, err_len);
+}
+
+static const schema_check_t cmd_schema[NR_AIC_CMD] = {
+  [AIC_CMD_TASK_ADD]    = check_new_task,
+  [AIC_CMD_TASK_MULTI]  = check_new_tasks,
+  [AIC_CMD_TASK_UPDATE] = check_updated_task,
+};
+
+// Commands answering with one JSON object, which the server's JSON mode can
+// guarantee. Task multi answers with an array, which that mode cannot produce.
+static const bool cmd_json_object[NR_AIC_CMD] = {
+  [AIC_CMD_TASK_ADD]    = true,
+  [AIC_CMD_TASK_UPDATE] = true,
+};
+
+static aic_json_stats_t json_stats[NR_AIC_CMD];
+static pthread_mutex_t json_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+  pthread_mutex_lock(&share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+  pthread_mutex_unlock(&share_locks[data]);
+}
+
+// Options that stay the same for every request; the endpoint comes with the
+// route of each request
+static CURL *create_handle(void) {
+  CURL *curl = curl_easy_init();
+  if (!curl) return NULL;
+
+  curl_easy_setopt(curl, CURLOPT_POST, 1L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+  curl_easy_setopt(curl, CURLOPT_SHARE, share);
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 60L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 30L);
+  curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 600L);
+  return curl;
+}
+
+// Borrows an idle handle; if all of them are in use, waits or returns NULL
+static CURL *acquire_handle(bool wait) {
+  CURL *curl = NULL;
+
+  pthread_mutex_lock(&pool_lock);
+  for (;;) {
+    int i;
+    for (i = 0; i < AIC_POOL_SIZE; i ++) {
+      if (!handle_pool[i].busy) break;
+    }
+    if (i < AIC_POOL_SIZE) {
+      if (handle_pool[i].curl == NULL) {
+        handle_pool[i].curl = create_handle();
+      }
+      if (handle_pool[i].curl != NULL) {
+        handle_pool[i].busy = true;
+        curl = handle_pool[i].curl;
+      }
+      break;
+    }
+    if (!wait) break;
+    pthread_cond_wait(&pool_cond, &pool_lock);
+  }
+  pthread_mutex_unlock(&pool_lock);
+  return curl;
+}
+
+static void release_handle(CURL *curl) {
+  pthread_mutex_lock(&pool_lock);
+  for (int i = 0; i < AIC_POOL_SIZE; i ++) {
+    if (handle_pool[i].curl == curl) {
+      handle_pool[i].busy = false;
+      break;
+    }
+  }
+  pthread_cond_signal(&pool_cond);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+// Per-request options: endpoint, body, response sink and the current timeouts
+static void prepare_request(CURL *curl, const aic_body_t *body, aic_request_t *req) {
+  const route_t *route = body->route;
+  curl_easy_setopt(curl, CURLOPT_URL, route->url);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, route->headers);
+  if (body->json) {
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->json);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)-1);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, NULL);
+  } else {
+    // Every attempt reads the body from the start with its own cursor
+    req->body = body->rope;
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, body->len);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, ReadCallback);
+    curl_easy_setopt(curl, CURLOPT_READDATA, (void *)&req->body);
+    curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, SeekCallback);
+    curl_easy_setopt(curl, CURLOPT_SEEKDATA, (void *)&req->body);
+  }
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)req);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, policy.connect_timeout_ms);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, route->timeout_ms ? route->timeout_ms : policy.timeout_ms);
+  // A connection that goes silent is given up after stall_ms
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, policy.stall_ms > 0 ? 1L : 0L);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (policy.stall_ms + 999) / 1000);
+  req->start_us = now_us();
+}
+
+// Transport errors and overload/server statuses are worth another attempt
+static bool is_retryable(CURLcode res, long status) {
+  switch (res) {
+    case CURLE_OK:
+      return status == 408 || status == 429 || status >= 500;
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_SSL_CONNECT_ERROR:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_HTTP2:
+    case CURLE_HTTP2_STREAM:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Exponential backoff with full jitter; a server-sent Retry-After wins if longer
+static long backoff_ms(int attempt, long retry_after_ms) {
+  long cap = policy.backoff_base_ms;
+  for (int i = 0; i < attempt && cap < policy.backoff_max_ms; i ++) cap *= 2;
+  if (cap > policy.backoff_max_ms) cap = policy.backoff_max_ms;
+  long delay = cap > 0 ? rand() % (cap + 1) : 0;
+
+  if (retry_after_ms > delay) {
+    delay = retry_after_ms < policy.backoff_max_ms ? retry_after_ms : policy.backoff_max_ms;
+  }
+  return delay;
+}
+
+static long retry_after_ms(CURL *curl) {
+  curl_off_t retry_after = 0;
+  curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after);
+  return (long)retry_after * 1000;
+}
+
+// Logs the local prompt estimate next to the usage the API reported
+static void record_usage(aic_cmd_e cmd, size_t estimated, const aic_request_t *req) {
+  const tok_usage_t *u = &req->usage;
+  if (u->prompt_tokens <= 0) return;
+  tok_record(cmd, estimated, u, req->first_byte_us ? req->first_byte_us - req->start_us : 0);
+
+  call_timing.prompt_tokens = u->prompt_tokens;
+  call_timing.cached_tokens = u->cache_hit_tokens;
+  call_timing.completion_tokens = u->completion_tokens;
+  pthread_mutex_lock(&pool_lock);
+  last_timing.prompt_tokens = u->prompt_tokens;
+  last_timing.cached_tokens = u->cache_hit_tokens;
+  last_timing.completion_tokens = u->completion_tokens;
+  pthread_mutex_unlock(&pool_lock);
+  log_write("[aic] %s tokens: estimated %zu, prompt %ld (%+ld), cached %ld, completion %ld\n",
+      aic_cmd_name(cmd), estimated, u->prompt_tokens,
+      (long)estimated - u->prompt_tokens, u->cache_hit_tokens, u->completion_tokens);
+}
+
+// Splits libcurl's cumulative timers into per-phase durations
+static void record_timing(CURL *curl, const aic_request_t *req) {
+  curl_off_t namelookup = 0, connect = 0, appconnect = 0;
+  curl_off_t pretransfer = 0, starttransfer = 0, total = 0;
+  long nr_connects = 0;
+  aic_timing_t t = { 0 };
+
+  curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+  curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+  curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+  curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+  curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+  curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &nr_connects);
+
+  t.dns_us     = namelookup;
+  t.connect_us = connect > namelookup ? connect - namelookup : 0;
+  t.tls_us     = appconnect > connect ? appconnect - connect : 0;
+  t.ttfb_us    = starttransfer > pretransfer ? starttransfer - pretransfer : 0;
+  t.total_us   = total;
+  t.ttft_us    = req->first_token_us ? req->first_token_us - req->start_us : 0;
+  t.reused     = (nr_connects == 0);
+
+  call_timing = t;
+  pthread_mutex_lock(&pool_lock);
+  last_timing = t;
+  pthread_mutex_unlock(&pool_lock);
+
+  log_write("[aic] dns=%ldus connect=%ldus tls=%ldus ttfb=%ldus ttft=%ldus total=%ldus%s\n",
+      (long)t.dns_us, (long)t.connect_us, (long)t.tls_us, (long)t.ttfb_us,
+      (long)t.ttft_us, (long)t.total_us, t.reused ? " (reused connection)" : "");
+}
+
 // --- Public Functions ---
 
+// Explicit setting, then the environment, then the compiled-in default
+static const char *config_value(const char *set, const char *env, const char *def) {
+  if (set != NULL) return set;
+  const char *value = getenv(env);
+  return (value != NULL && *value != '\0') ? value : def;
+}
+
+int aic_set_endpoint(const char *url, const char *model, const char *api_key) {
+  if (is_initialized) return -1;
+  if (url) aic_url = url;
+  if (model) aic_model = model;
+  if (api_key) aic_api_key = api_key;
+  return 0;
+}
+
+const char *aic_get_url(void) {
+  return aic_url;
+}
+
+const char *aic_get_model(void) {
+  return aic_model;
+}
+
+static char *trim(char *s) {
+  while (isspace((unsigned char)*s)) s ++;
+  char *end = s + strlen(s);
+  while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+  return s;
+}
+
+// Applies one "key = value" line of the routes file; -1 if it is not understood
+static int set_route(route_t *r, const char *key, const char *value) {
+  char *end = NULL;
+  char **str = NULL;
+
+  if (strcmp(key, "url") == 0) str = &r->url;
+  else if (strcmp(key, "model") == 0) str = &r->model;
+  else if (strcmp(key, "api_key") == 0) str = &r->api_key;
+  if (str) {
+    if (*value == '\0') return -1;
+    free(*str);
+    *str = strdup(value);
+    if (!*str) panic("Memory allocation failed for AI route.");
+    return 0;
+  }
+
+  if (strcmp(key, "json_mode") == 0) {
+    if (strcmp(value, "on") == 0 || strcmp(value, "true") == 0 || strcmp(value, "1") == 0) {
+      r->json_mode = true;
+    } else if (strcmp(value, "off") == 0 || strcmp(value, "false") == 0 || strcmp(value, "0") == 0) {
+      r->json_mode = false;
+    } else {
+      return -1;
+    }
+    r->has_json_mode = true;
+    return 0;
+  }
+
+  if (strcmp(key, "temperature") == 0) {
+    double t = strtod(value, &end);
+    if (end == value || *end != '\0' || t < 0 || t > 2) return -1;
+    r->temperature = t;
+    r->has_temperature = true;
+    return 0;
+  }
+
+  long n = strtol(value, &end, 10);
+  if (end == value || *end != '\0' || n <= 0) return -1;
+  if (strcmp(key, "max_tokens") == 0) r->max_tokens = n;
+  else if (strcmp(key, "timeout_ms") == 0) r->timeout_ms = n;
+  else return -1;
+  return 0;
+}
+
+int aic_load_routes(const char *path) {
+  if (is_initialized) return -1;
+  path = config_value(path, "AIC_ROUTES", NULL);
+  if (path == NULL) return 0;
+
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) {
+    Log("Cannot open AI routes file '%s'.", path);
+    return -1;
+  }
+
+  char buf[1024];
+  route_t *r = NULL;
+  bool skip = false;   // inside an unknown section
+  int line = 0, nr_errors = 0;
+  while (fgets(buf, sizeof(buf), fp) != NULL) {
+    char *s = trim(buf);
+    line ++;
+    if (*s == '\0' || *s == '#' || *s == ';') continue;
+
+    if (*s == '[') {
+      char *end = strchr(s, ']');
+      if (end) *end = '\0';
+      const char *name = trim(s + 1);
+      r = NULL;
+      if (end && strcmp(name, "*") == 0) r = &routes[ANY_ROUTE];
+      for (int cmd = 0; end && cmd < NR_AIC_CMD && !r; cmd ++) {
+        if (strcmp(name, aic_cmd_name(cmd)) == 0) r = &routes[cmd];
+      }
+      skip = (r == NULL);
+      if (skip) {
+        Log("%s:%d: unknown AI route '%s', expected a command name or '*'", path, line, name);
+        nr_errors ++;
+      }
+      continue;
+    }
+
+    char *eq = strchr(s, '=');
+    if (skip) continue;
+    if (r == NULL || eq == NULL) {
+      Log("%s:%d: expected 'key = value' inside a [command] section", path, line);
+      nr_errors ++;
+      continue;
+    }
+    *eq = '\0';
+    char *key = trim(s);
+    if (set_route(r, key, trim(eq + 1)) != 0) {
+      Log("%s:%d: ignoring invalid route setting '%s'", path, line, key);
+      nr_errors ++;
+    }
+  }
+  fclose(fp);
+  Log("AI routes loaded from %s%s", path, nr_errors ? " (with errors)" : "");
+  return nr_errors ? -1 : 0;
+}
+
+void aic_get_route(aic_cmd_e cmd, aic_route_info_t *info) {
+  const route_t *r = &routes[cmd];
+  info->url = r->url;
+  info->model = r->model;
+  info->max_tokens = r->max_tokens;
+  info->temperature = r->has_temperature ? r->temperature : -1;
+  info->timeout_ms = r->timeout_ms ? r->timeout_ms : policy.timeout_ms;
+  info->json_mode = r->json_mode;
+}
+
+// Fills in what the routes file left unset and builds the request template
+static void build_route(aic_cmd_e cmd) {
+  route_t *r = &routes[cmd];
+  const route_t *any = &routes[ANY_ROUTE];
+
+  if (!r->url) r->url = strdup(any->url ? any->url : aic_url);
+  if (!r->model) r->model = strdup(any->model ? any->model : aic_model);
+  if (!r->api_key) r->api_key = strdup(any->api_key ? any->api_key : aic_api_key);
+  Assert(r->url && r->model && r->api_key, "Failed to build the AI route.");
+  if (!r->max_tokens) r->max_tokens = any->max_tokens;
+  if (!r->has_temperature) {
+    r->temperature = any->temperature;
+    r->has_temperature = any->has_temperature;
+  }
+  if (!r->timeout_ms) r->timeout_ms = any->timeout_ms;
+  // JSON mode is on by default wherever it applies; routes to servers
+  // without it turn it off
+  if (!r->has_json_mode) r->json_mode = any->has_json_mode ? any->json_mode : true;
+  r->json_mode = r->json_mode && cmd_json_object[cmd];
+
+  char auth_header[256];
+  snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", r->api_key);
+  r->headers = curl_slist_append(r->headers, "Content-Type: application/json");
+  r->headers = curl_slist_append(r->headers, auth_header);
+  Assert(r->headers, "Failed to build HTTP headers.");
+
+  const char *system = aic_system_prompt(cmd);
+  char *model = rope_escape(r->model);
+  char *content = rope_escape(system);
+  Assert(model && content, "Failed to build the request template.");
+  size_t head_len = strlen(model) + strlen(content) + 128;
+  r->head = malloc(head_len);
+  Assert(r->head, "Failed to build the request template.");
+  snprintf(r->head, head_len,
+      "{\"model\":\"%s\",\"messages\":[{\"role\":\"system\",\"content\":"
+      "\"%s\"},{\"role\":\"user\",\"content\":\"", model, content);
+  r->system_tokens = aic_estimate_tokens(system, strlen(system));
+  free(content);
+  free(model);
+
+  // Sampling parameters and the answer format follow "stream"
+  char params[160] = "";
+  size_t n = 0;
+  if (r->max_tokens) n += snprintf(params + n, sizeof(params) - n, ",\"max_tokens\":%ld", r->max_tokens);
+  if (r->has_temperature) n += snprintf(params + n, sizeof(params) - n, ",\"temperature\":%g", r->temperature);
+  if (r->json_mode) snprintf(params + n, sizeof(params) - n, ",\"response_format\":{\"type\":\"json_object\"}");
+  for (int stream = 0; stream < 2; stream ++) {
+    size_t len = strlen(params) + 32;
+    r->tail[stream] = malloc(len);
+    Assert(r->tail[stream], "Failed to build the request template.");
+    snprintf(r->tail[stream], len, "\"}],\"stream\":%s%s}", stream ? "true" : "false", params);
+  }
+}
+
+static void free_route(route_t *r) {
+  SAFE_FREE(r->url);
+  SAFE_FREE(r->model);
+  SAFE_FREE(r->api_key);
+  SAFE_FREE(r->head);
+  SAFE_FREE(r->tail[0]);
+  SAFE_FREE(r->tail[1]);
+  curl_slist_free_all(r->headers);
+  memset(r, 0, sizeof(*r));
+}
+
 int aic_init(void) {
   if (is_initialized) return 0;
-  
+
+  aic_url = config_value(aic_url, "AIC_URL", AIC_URL);
+  aic_model = config_value(aic_model, "AIC_MODEL", AIC_MODEL);
+  aic_api_key = config_value(aic_api_key, "AIC_API_KEY", AIC_API_KEY);
+  if (*aic_api_key == '\0') {
+    Log("WARN: No API key configured (--ai-key or AIC_API_KEY).");
+  }
+  Log("AI endpoint: %s (model %s)", aic_url, aic_model);
+
   // Initialize libcurl globally
   CURLcode res = curl_global_init(CURL_GLOBAL_DEFAULT);
   Assert(res == CURLE_OK,
     "curl_global_init() failed: %s", curl_easy_strerror(res));
+
+  // Share DNS, TLS sessions and live connections between all pooled handles
+  for (int i = 0; i < CURL_LOCK_DATA_LAST; i ++) {
+    pthread_mutex_init(&share_locks[i], NULL);
+  }
+  share = curl_share_init();
+  Assert(share, "curl_share_init() failed.");
+  curl_share_setopt(share, CURLSHOPT_LOCKFUNC, share_lock);
+  curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+  for (int cmd = 0; cmd < NR_AIC_CMD; cmd ++) build_route(cmd);
+  for (int cmd = 0; cmd < NR_AIC_CMD; cmd ++) {
+    route_t *r = &routes[cmd];
+    if (strcmp(r->url, aic_url) != 0 || strcmp(r->model, aic_model) != 0) {
+      Log("AI route %s: %s (model %s)", aic_cmd_name(cmd), r->url, r->model);
+    }
+  }
+
   is_initialized = 1;
   return 0;
 }
 
 void aic_cleanup(void) {
   if (is_initialized) {
+    for (int i = 0; i < AIC_POOL_SIZE; i ++) {
+      if (handle_pool[i].curl) curl_easy_cleanup(handle_pool[i].curl);
+      handle_pool[i].curl = NULL;
+      handle_pool[i].busy = false;
+    }
+    curl_share_cleanup(share);
+    share = NULL;
+    for (int i = 0; i <= ANY_ROUTE; i ++) free_route(&routes[i]);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i ++) {
+      pthread_mutex_destroy(&share_locks[i]);
+    }
+    rc_shutdown();
     curl_global_cleanup();
     is_initialized = 0;
   }
 }
 
+int aic_cache_init(const char *path) {
+  return rc_init(path);
+}
+
+void aic_get_cache_stats(aic_cache_stats_t *stats) {
+  rc_get_stats(stats);
+}
+
+void aic_set_local_parse(bool enable) {
+  local_parse_enabled = enable;
+}
+
+void aic_get_local_stats(aic_local_stats_t *stats) {
+  pthread_mutex_lock(&local_lock);
+  *stats = local_stats;
+  pthread_mutex_unlock(&local_lock);
+}
+
+char* aic_task_add_local(const char *task_input) {
+  if (!local_parse_enabled || task_input == NULL) return NULL;
+
+  int64_t start = now_us();
+  lp_task_t task;
+  int ret = lp_parse_task(task_input, time(NULL), &task);
+  char *json = NULL;
+
+  if (ret == 0) {
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "title", task.title);
+    cJSON_AddStringToObject(root, "description", "");
+    cJSON_AddNumberToObject(root, "due_date", (double)task.due_date);
+    cJSON_AddNumberToObject(root, "prio", task.prio);
+    json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+  }
+
+  pthread_mutex_lock(&local_lock);
+  if (json) {
+    local_stats.local ++;
+    local_stats.local_us += now_us() - start;
+  } else {
+    local_stats.fallback ++;
+  }
+  pthread_mutex_unlock(&local_lock);
+  return json;
+}
+
+void aic_set_policy(const aic_policy_t *p) {
+  if (p) policy = *p;
+}
+
+void aic_get_policy(aic_policy_t *p) {
+  if (p) *p = policy;
+}
+
+void aic_get_latency(aic_cmd_e cmd, aic_latency_t *lat) {
+  lat_get(cmd, lat);
+}
+
+aic_error_e aic_last_error(void) {
+  return last_error;
+}
+
+void aic_get_call_timing(aic_timing_t *timing) {
+  *timing = call_timing;
+}
+
+void aic_get_json_stats(aic_cmd_e cmd, aic_json_stats_t *st) {
+  pthread_mutex_lock(&json_lock);
+  *st = json_stats[cmd];
+  pthread_mutex_unlock(&json_lock);
+}
+
+const char *aic_cmd_name(aic_cmd_e cmd) {
+  static const char *names[NR_AIC_CMD] = {
+    [AIC_CMD_CHAT]        = "chat",
+    [AIC_CMD_TASK_ADD]    = "task add",
+    [AIC_CMD_TASK_MULTI]  = "task multi",
+    [AIC_CMD_TASK_UPDATE] = "task update",
+    [AIC_CMD_SUGGEST]     = "suggest",
+    [AIC_CMD_REPORT]      = "report",
+    [AIC_CMD_SUMMARY]     = "summary",
+  };
+  return (cmd >= 0 && cmd < NR_AIC_CMD) ? names[cmd] : "unknown";
+}
+
+void aic_set_streaming(bool enable) {
+  stream_enabled = enable;
+}
+
+void aic_get_last_timing(aic_timing_t *timing) {
+  pthread_mutex_lock(&pool_lock);
+  *timing = last_timing;
+  pthread_mutex_unlock(&pool_lock);
+}
+
 char* aic_call(const char *prompt) {
-  Assert(is_initialized, "Error: aic_init() must be called first.");
-  CURL *curl = NULL;
+  return aic_call_cmd(AIC_CMD_CHAT, prompt);
+}
+
+char* aic_call_cmd(aic_cmd_e cmd, const char *prompt) {
+  return aic_call_stream(cmd, prompt, NULL, NULL);
+}
+
+// What one round trip (possibly hedged) ended with
+typedef struct {
   CURLcode res;
-  struct curl_slist *headers = NULL;
-  MemoryStruct_t chunk = {NULL, 0};
-  char auth_header[256];
-  char *json_data = NULL;
-  char *ai_response = NULL;
+  long status;
+  long retry_after_ms;
+  bool delivered;        // answer text was already handed to the caller
+} aic_outcome_t;
+
+// Runs attempt 0 on a private multi handle and fires attempt 1 on a second
+// pooled handle if no byte has arrived after hedge_us. Returns the attempt
+// that decided the call: the first to succeed, or the last to fail.
+static int perform_hedged(aic_cmd_e cmd, CURL *curls[2], aic_request_t reqs[2],
+    const aic_body_t *body, int64_t hedge_us, CURLcode *res) {
+  CURLM *multi = curl_multi_init();
+  bool running[2] = { true, false };
+  bool hedge_done = false;
+  int decided = -1;
 
-  // 1. Prepare
-  chunk.memory = malloc(1); 
-  if (!chunk.memory) {
-    panic("Memory allocation failed for chunk.memory.");
-    goto cleanup;
+  if (!multi) {
+    *res = CURLE_OUT_OF_MEMORY;
+    return 0;
   }
+  prepare_request(curls[0], body, &reqs[0]);
+  curl_multi_add_handle(multi, curls[0]);
+  int64_t hedge_at = reqs[0].start_us + hedge_us;
+
+  while (decided < 0) {
+    int nr_running = 0;
+    curl_multi_perform(multi, &nr_running);
+
+    CURLMsg *msg;
+    int nr_msgs;
+    while ((msg = curl_multi_info_read(multi, &nr_msgs)) != NULL) {
+      if (msg->msg != CURLMSG_DONE) continue;
+      int i = (msg->easy_handle == curls[0]) ? 0 : 1;
+      running[i] = false;
+      curl_multi_remove_handle(multi, curls[i]);
 
-  json_data = create_request_json(prompt);
-  if (!json_data) {
-    Log(ANSI_FMT("Failed to create JSON request body.", ANSI_FG_RED));
-    goto cleanup;
+      bool ok = msg->data.result == CURLE_OK &&
+                (*reqs[i].winner == NULL || *reqs[i].winner == &reqs[i]);
+      if (decided < 0 && (ok || !running[!i])) {
+        decided = i;
+        *res = msg->data.result;
+      }
+    }
+    if (decided >= 0) break;
+
+    if (!hedge_done && reqs[0].first_byte_us != 0) hedge_done = true;
+    if (!hedge_done && now_us() >= hedge_at) {
+      hedge_done = true;
+      curls[1] = acquire_handle(false);
+      if (curls[1]) {
+        log_write("[aic] no first byte after %ld ms, hedging\n", (long)(hedge_us / 1000));
+        prepare_request(curls[1], body, &reqs[1]);
+        curl_multi_add_handle(multi, curls[1]);
+        running[1] = true;
+        lat_count_hedge(cmd);
+      }
+    }
+
+    int timeout_ms = 1000;
+    if (!hedge_done) {
+      int64_t wait_ms = (hedge_at - now_us() + 999) / 1000;
+      if (wait_ms < timeout_ms) timeout_ms = wait_ms > 0 ? (int)wait_ms : 0;
+    }
+    curl_multi_poll(multi, NULL, 0, timeout_ms, NULL);
   }
 
-  // 2. Setup Headers
-  snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", AIC_API_KEY);
-  headers = curl_slist_append(headers, "Content-Type: application/json");
-  headers = curl_slist_append(headers, auth_header);
-  
-  // 3. Setup and Execute libcurl
-  curl = curl_easy_init();
-  if (!curl) {
+  // Abandon the attempt that lost
+  for (int i = 0; i < 2; i ++) {
+    if (running[i]) curl_multi_remove_handle(multi, curls[i]);
+  }
+  curl_multi_cleanup(multi);
+  if (decided == 1) lat_count_hedge_win(cmd);
+  return decided;
+}
+
+// One round trip on pooled handles, hedged once the command has a p95 to go by
+static char *perform_once(aic_cmd_e cmd, const aic_body_t *body, size_t estimated,
+    aic_token_cb on_token, void *userp, aic_outcome_t *out) {
+  aic_request_t reqs[2] = { { .stream = stream_enabled }, { .stream = stream_enabled } };
+  aic_request_t *winner = NULL;
+  CURL *curls[2] = { NULL, NULL };
+  char *ai_response = NULL;
+  int decided = 0;
+
+  memset(out, 0, sizeof(*out));
+  curls[0] = acquire_handle(true);
+  if (!curls[0]) {
     Log(ANSI_FMT("curl_easy_init() failed.", ANSI_FG_RED));
-    goto cleanup;
+    out->res = CURLE_FAILED_INIT;
+    return NULL;
   }
+  sse_init(&reqs[0].sse, on_token, userp);
+  sse_init(&reqs[1].sse, on_token, userp);
 
-  curl_easy_setopt(curl, CURLOPT_URL, AIC_URL);
-  curl_easy_setopt(curl, CURLOPT_POST, 1L);
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_data);
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
-  
-  res = curl_easy_perform(curl);
-  
-  if(res != CURLE_OK) {
-    Log(ANSI_FMT("curl_easy_perform() failed: %s", ANSI_FG_RED), curl_easy_strerror(res));
-    goto cleanup;
+  int64_t hedge_us = policy.hedge ? lat_hedge_delay_us(cmd) : -1;
+  if (hedge_us < 0) {
+    prepare_request(curls[0], body, &reqs[0]);
+    out->res = curl_easy_perform(curls[0]);
+  } else {
+    reqs[0].winner = reqs[1].winner = &winner;
+    decided = perform_hedged(cmd, curls, reqs, body, hedge_us, &out->res);
   }
 
-  // 4. Process Response
-  cJSON *response_json = cJSON_Parse(chunk.memory);
-  cJSON *choices, *first_choice, *message, *content;
-  
-  if (!response_json) {
-    Log(ANSI_FMT("Failed to parse JSON response. Raw: %s",
-      ANSI_FG_RED), chunk.memory);
-    goto json_cleanup;
+  aic_request_t *req = &reqs[decided];
+  CURL *curl = curls[decided];
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &out->status);
+  out->retry_after_ms = retry_after_ms(curl);
+  out->delivered = req->sse.nr_tokens > 0;
+  record_timing(curl, req);
+
+  if (cmd == AIC_CMD_TASK_ADD && out->res == CURLE_OK) {
+    pthread_mutex_lock(&local_lock);
+    local_stats.remote ++;
+    local_stats.remote_us += now_us() - reqs[0].start_us;
+    pthread_mutex_unlock(&local_lock);
   }
-  
-  choices = cJSON_GetObjectItemCaseSensitive(response_json, "choices");
-  if (!choices) {
-    Log(ANSI_FMT("JSON structure error: Missing 'choices'. Raw: %s",
-      ANSI_FG_RED), chunk.memory);
-    goto json_cleanup;
+
+  if (out->res != CURLE_OK) {
+    Log(ANSI_FMT("curl_easy_perform() failed: %s", ANSI_FG_RED), curl_easy_strerror(out->res));
+  } else if (out->status >= 400) {
+    Log(ANSI_FMT("API error: HTTP %ld: %s", ANSI_FG_RED), out->status,
+        req->raw.memory ? req->raw.memory : "");
+  } else if (req->stream && req->sse.nr_events > 0) {
+    // Tokens were already reported; hand back the assembled content
+    if (!req->sse.done) {
+      Log(ANSI_FMT("WARN: Stream ended without [DONE], answer may be truncated.", ANSI_FG_YELLOW));
+    }
+    ai_response = strdup(req->sse.content.memory ? req->sse.content.memory : "");
+    if (!ai_response) { panic("Memory allocation failed for ai_response."); }
+    req->usage = req->sse.usage;
+  } else {
+    // Plain JSON: streaming disabled, unsupported by the server, or an error body
+    ai_response = parse_response(req->raw.memory ? req->raw.memory : "", req);
+    if (ai_response && on_token) {
+      on_token(ai_response, strlen(ai_response), userp);
+      out->delivered = true;
+    }
   }
 
-  first_choice = cJSON_GetArrayItem(choices, 0);
-  if (!first_choice) {
-    Log(ANSI_FMT("JSON structure error: Missing first choice item. Raw: %s",
-      ANSI_FG_RED), chunk.memory);
-    goto json_cleanup;
+  // Total is what the caller waited; first byte is per attempt, it drives hedging
+  if (ai_response) {
+    lat_record(cmd, now_us() - reqs[0].start_us,
+        req->first_byte_us ? req->first_byte_us - req->start_us : 0);
+    record_usage(cmd, estimated, req);
   }
+  lat_count_request(cmd, ai_response == NULL);
 
-  message = cJSON_GetObjectItemCaseSensitive(first_choice, "message");
-  if (!message) {
-    Log(ANSI_FMT("JSON structure error: Missing 'message'. Raw: %s", ANSI_FG_RED), chunk.memory);
-    goto json_cleanup;
+  for (int i = 0; i < 2; i ++) {
+    if (curls[i]) release_handle(curls[i]);
+    SAFE_FREE(reqs[i].raw.memory);
+    sse_free(&reqs[i].sse);
   }
+  return ai_response;
+}
 
-  content = cJSON_GetObjectItemCaseSensitive(message, "content");
-  
-  if (cJSON_IsString(content) && content->valuestring != NULL) {
-    // Duplicate the string so that cJSON_Delete doesn't free it
-    ai_response = strdup(content->valuestring);
-    if (!ai_response) { panic("Memory allocation failed for ai_response."); }
-  } else {
-    // Likely API error message in the response
-    Log(ANSI_FMT("API error or content extraction failed. Full response:\n%s",
-      ANSI_FG_RED), chunk.memory);
+static void inflight_put(inflight_t *f) {
+  if (-- f->refs > 0) return;
+  free(f->answer);
+  free(f);
+}
+
+/**
+ * Joins the request for key if one is in flight: waits for it and returns 1
+ * with *answer set to a private copy (NULL if it failed). Otherwise registers
+ * the caller as the one performing it and returns 0 with *self set; the caller
+ * must then finish with inflight_done().
+ */
+static int inflight_join(const uint64_t key[2], char **answer, inflight_t **self) {
+  pthread_mutex_lock(&inflight_lock);
+  for (inflight_t *f = inflight_list; f; f = f->next) {
+    if (f->key[0] != key[0] || f->key[1] != key[1]) continue;
+    f->refs ++;
+    while (!f->done) pthread_cond_wait(&inflight_cond, &inflight_lock);
+    *answer = f->answer ? strdup(f->answer) : NULL;
+    if (f->answer && !*answer) panic("Memory allocation failed for ai_response.");
+    last_error = f->error;
+    inflight_put(f);
+    pthread_mutex_unlock(&inflight_lock);
+    return 1;
   }
 
-json_cleanup:
-  cJSON_Delete(response_json);
+  inflight_t *f = calloc(1, sizeof(inflight_t));
+  if (!f) panic("Memory allocation failed for in-flight request.");
+  memcpy(f->key, key, sizeof(f->key));
+  f->refs = 1;
+  f->next = inflight_list;
+  inflight_list = f;
+  pthread_mutex_unlock(&inflight_lock);
+  *self = f;
+  return 0;
+}
+
+// Publishes the answer (copied), or the caller's last_error, to the waiters
+// and unregisters the request
+static void inflight_done(inflight_t *f, const char *answer) {
+  pthread_mutex_lock(&inflight_lock);
+  for (inflight_t **p = &inflight_list; *p; p = &(*p)->next) {
+    if (*p == f) { *p = f->next; break; }
+  }
+  if (answer && f->refs > 1) {
+    f->answer = strdup(answer);
+    if (!f->answer) panic("Memory allocation failed for ai_response.");
+  }
+  f->error = last_error;
+  f->done = true;
+  pthread_cond_broadcast(&inflight_cond);
+  inflight_put(f);
+  pthread_mutex_unlock(&inflight_lock);
+}
+
+static char *call_prompt(aic_cmd_e cmd, const aic_prompt_t *prompt, aic_token_cb on_token,
+    void *userp, bool correction);
+
+// The JSON value of an answer if it fits the command's schema; otherwise NULL
+// with the reason, worded for the model, in err
+static char *checked_json(aic_cmd_e cmd, const char *answer, bool *clean, char *err, size_t err_len) {
+  char *json = jr_extract(answer, cmd_json_object[cmd], clean);
+  if (json == NULL) {
+    snprintf(err, err_len, "it holds no JSON %s", cmd_json_object[cmd] ? "object" : "array");
+    return NULL;
+  }
+  if (cmd_schema[cmd](json, err, err_len) != 0) {
+    free(json);
+    return NULL;
+  }
+  return json;
+}
+
+static const char *CORRECTION_PROMPT =
+  "Your answer cannot be used: %s.\n"
+  "Reply with only the corrected JSON, without any other text or code block markers.";
+
+// Follow-up to a rejected answer naming what is wrong. Takes ownership of original.
+static aic_prompt_t *correction_prompt(char *original, const char *answer, const char *err) {
+  if (!original) panic("Memory allocation failed for correction prompt.");
+  aic_prompt_t *retry = aic_prompt_new();
+  aic_prompt_add_owned(retry, original);
+  rope_add_raw(retry, ROPE_TO_ASSISTANT);
+  aic_prompt_add(retry, answer);
+  rope_add_raw(retry, ROPE_TO_USER);
+  aic_prompt_addf(retry, CORRECTION_PROMPT, err);
+  return retry;
+}
+
+static void count_json_answer(aic_cmd_e cmd, bool clean, bool corrected, bool ok) {
+  pthread_mutex_lock(&json_lock);
+  aic_json_stats_t *st = &json_stats[cmd];
+  st->answers ++;
+  if (!corrected && clean) st->clean ++;
+  if (!corrected && !clean) st->extracted ++;
+  if (corrected) st->corrections ++;
+  if (corrected && ok) st->corrected ++;
+  if (!ok) st->failed ++;
+  pthread_mutex_unlock(&json_lock);
+}
+
+/**
+ * Reduces a JSON answer to its JSON value and checks it against the command's
+ * schema. Prose or code fences around a valid value are dropped without
+ * another round trip; only a real schema failure is re-prompted, once, as a
+ * follow-up to the bad answer naming what is wrong. Takes ownership of answer.
+ */
+static char *validate_answer(aic_cmd_e cmd, const aic_prompt_t *prompt, char *answer) {
+  char err[256];
+  bool clean = false;
+  bool corrected = false;
+  char *json = checked_json(cmd, answer, &clean, err, sizeof(err));
+
+  if (json == NULL) {
+    log_write("[aic] %s: answer rejected (%s), asking for a correction\n", aic_cmd_name(cmd), err);
+    aic_prompt_t *retry = correction_prompt(aic_prompt_flatten(prompt), answer, err);
+    char *second = call_prompt(cmd, retry, NULL, NULL, true);
+    aic_prompt_free(retry);
+    if (second) {
+      json = checked_json(cmd, second, &clean, err, sizeof(err));
+      free(second);
+    }
+    if (json == NULL) {
+      Log(ANSI_FMT("AI answer for %s rejected: %s", ANSI_FG_RED), aic_cmd_name(cmd), err);
+    }
+    corrected = true;
+  }
+
+  count_json_answer(cmd, clean, corrected, json != NULL);
+  free(answer);
+  return json;
+}
+
+// Only checked JSON answers are stored, but entries written before that may not be
+static char *cached_answer(aic_cmd_e cmd, const uint64_t key[2]) {
+  char *answer = rc_get(key);
+  if (answer && cmd_schema[cmd]) {
+    char err[256];
+    bool clean;
+    char *json = checked_json(cmd, answer, &clean, err, sizeof(err));
+    free(answer);
+    answer = json;
+  }
+  return answer;
+}
+
+char* aic_call_stream(aic_cmd_e cmd, const char *prompt, aic_token_cb on_token, void *userp) {
+  aic_prompt_t *rope = aic_prompt_new();
+  aic_prompt_add(rope, prompt);
+  char *ai_response = aic_call_prompt(cmd, rope, on_token, userp);
+  aic_prompt_free(rope);
+  return ai_response;
+}
+
+char* aic_call_prompt(aic_cmd_e cmd, const aic_prompt_t *prompt, aic_token_cb on_token, void *userp) {
+  return call_prompt(cmd, prompt, on_token, userp, false);
+}
+
+// A correction is neither cached nor checked again
+static char *call_prompt(aic_cmd_e cmd, const aic_prompt_t *prompt, aic_token_cb on_token,
+    void *userp, bool correction) {
+  Assert(is_initialized, "Error: aic_init() must be called first.");
+  long ttl = correction ? AIC_TTL_NONE : cmd_ttl[cmd];
+  uint64_t cache_key[2];
+  aic_body_t body = { .json = NULL };
+  size_t estimated = 0;
+  char *ai_response = NULL;
+  char buf[16 * 1024];
+  size_t n;
+
+  if (!correction) memset(&call_timing, 0, sizeof(call_timing));
+  if (!prompt) {
+    last_error = AIC_ERR_API;
+    return NULL;
+  }
+
+  // 1. Prepare: the body is streamed from the prompt pieces, never assembled.
+  //    One pass over it yields the Content-Length and the cache key
+  //    (identical endpoint + body). The key is taken over the plain body, as
+  //    batch items send it: streaming changes the transport, not the answer.
+  const route_t *route = &routes[cmd];
+  body.route = route;
+  rope_body_init(&body.rope, prompt, route->head, route->tail[0]);
+  rc_hash_t hash;
+  rc_hash_init(&hash);
+  rc_hash_update(&hash, route->url, strlen(route->url));
+  rc_hash_next_part(&hash);
+  while ((n = rope_body_read(&body.rope, buf, sizeof(buf))) > 0) {
+    rc_hash_update(&hash, buf, n);
+    body.len += n;
+  }
+  rc_hash_next_part(&hash);
+  rc_hash_final(&hash, cache_key);
+  body.len += (curl_off_t)strlen(route->tail[stream_enabled]) - (curl_off_t)strlen(route->tail[0]);
+  rope_body_init(&body.rope, prompt, route->head, route->tail[stream_enabled]);
+  estimated = route->system_tokens + aic_prompt_tokens(prompt) + TOK_REQUEST_OVERHEAD;
+
+  if (ttl != AIC_TTL_NONE) {
+    ai_response = cached_answer(cmd, cache_key);
+    if (ai_response) {
+      last_error = AIC_OK;
+      if (on_token) on_token(ai_response, strlen(ai_response), userp);
+      return ai_response;
+    }
+  }
+
+  // 2. An identical request already on the wire (from another thread or
+  //    background job) is shared: wait for it and take a copy
+  inflight_t *flight = NULL;
+  if (inflight_join(cache_key, &ai_response, &flight)) {
+    lat_count_coalesced(cmd);
+    log_write("[aic] %s: shared an identical request in flight\n", aic_cmd_name(cmd));
+    if (ai_response && on_token) on_token(ai_response, strlen(ai_response), userp);
+    return ai_response;
+  }
+
+  // 3. Round trips, retried with backoff while the failure is transient and
+  //    nothing has been shown to the caller yet
+  aic_outcome_t out;
+  for (int attempt = 0; ; attempt ++) {
+    ai_response = perform_once(cmd, &body, estimated, on_token, userp, &out);
+    if (ai_response || out.delivered || attempt >= policy.max_retries ||
+        !is_retryable(out.res, out.status)) {
+      break;
+    }
+    long delay = backoff_ms(attempt, out.retry_after_ms);
+    Log(ANSI_FMT("WARN: AI request failed, retry %d/%d in %ld ms", ANSI_FG_YELLOW),
+        attempt + 1, policy.max_retries, delay);
+    lat_count_retry(cmd);
+    usleep(delay * 1000);
+  }
+
+  if (ai_response) last_error = AIC_OK;
+  else last_error = is_retryable(out.res, out.status) ? AIC_ERR_NETWORK : AIC_ERR_API;
+
+  // JSON answers are cached and shared only once they fit the schema. A
+  // failed correction keeps the error of its own round trip.
+  if (ai_response && cmd_schema[cmd] && !correction) {
+    ai_response = validate_answer(cmd, prompt, ai_response);
+    if (ai_response == NULL && last_error == AIC_OK) last_error = AIC_ERR_ANSWER;
+  }
+  if (ai_response && ttl != AIC_TTL_NONE) rc_put(cache_key, ai_response, ttl);
+  inflight_done(flight, ai_response);
 
-cleanup:
-  // 5. Cleanup Resources
-  if (curl) curl_easy_cleanup(curl);
-  if (headers) curl_slist_free_all(headers);
-  if (json_data) free(json_data);
-  if (chunk.memory) free(chunk.memory);
-  
   return ai_response; // Returns the duplicated answer string or NULL
-}
\ No newline at end of file
+}
+
+// One entry of aic_call_batch()
+typedef struct {
+  char *json;
+  uint64_t key[2];
+  aic_request_t req;
+  char *answer;
+  size_t estimated;      // prompt tokens, estimated locally
+  int attempts;         // retries used so far
+  bool correcting;      // json now holds the correction request
+  bool done;
+} aic_batch_item_t;
+
+// Starts the next uncached item on the given easy handle; cache hits are completed inline
+static bool batch_start_next(aic_cmd_e cmd, CURLM *multi, CURL *curl, aic_batch_item_t *items,
+    int count, int *next_item, int *slot_item) {
+  const route_t *route = &routes[cmd];
+  while (*next_item < count) {
+    int i = (*next_item) ++;
+    aic_batch_item_t *item = &items[i];
+
+    if (item->done) continue;   // request body could not be built
+    if (cmd_ttl[cmd] != AIC_TTL_NONE) {
+      rc_make_key(route->url, item->json, item->key);
+      item->answer = cached_answer(cmd, item->key);
+      if (item->answer) {
+        item->done = true;
+        continue;
+      }
+    }
+
+    prepare_request(curl, &(aic_body_t){ .json = item->json, .route = route }, &item->req);
+    *slot_item = i;
+    curl_multi_add_handle(multi, curl);
+    return true;
+  }
+  return false;
+}
+
+int aic_call_batch(aic_cmd_e cmd, char *const prompts[], int count, int max_inflight,
+    aic_batch_cb on_result, void *userp) {
+  Assert(is_initialized, "Error: aic_init() must be called first.");
+  long ttl = cmd_ttl[cmd];
+  int next_item = 0, next_deliver = 0, in_flight = 0, nr_ok = 0;
+  int nr_slots = 0;
+
+  if (count <= 0) return 0;
+  if (max_inflight < 1) max_inflight = 1;
+  if (max_inflight > count) max_inflight = count;
+
+  aic_batch_item_t *items = calloc(count, sizeof(aic_batch_item_t));
+  CURL **slots = calloc(max_inflight, sizeof(CURL *));
+  int *slot_item = calloc(max_inflight, sizeof(int));
+  int64_t *slot_retry_at = calloc(max_inflight, sizeof(int64_t));  // 0: no retry pending
+  CURLM *multi = curl_multi_init();
+  if (!items || !slots || !slot_item || !slot_retry_at || !multi) {
+    panic("Memory allocation failed for AI batch.");
+  }
+
+  // Requests to the same host share connections (HTTP/2 multiplexes them on one)
+  curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)max_inflight);
+
+  for (int i = 0; i < count; i ++) {
+    items[i].json = create_request_json(&routes[cmd], prompts[i]);
+    items[i].estimated = routes[cmd].system_tokens + aic_estimate_tokens(prompts[i], strlen(prompts[i])) +
+                         TOK_REQUEST_OVERHEAD;
+    if (!items[i].json) {
+      Log(ANSI_FMT("Failed to create JSON request body for batch item %d.", ANSI_FG_RED), i);
+      items[i].done = true;
+    }
+  }
+  for (int i = 0; i < max_inflight; i ++) {
+    slots[i] = create_handle();
+    if (!slots[i]) {
+      Log(ANSI_FMT("curl_easy_init() failed.", ANSI_FG_RED));
+      break;
+    }
+    curl_easy_setopt(slots[i], CURLOPT_PRIVATE, (void *)(intptr_t)i);
+    nr_slots ++;
+  }
+
+  for (int s = 0; s < nr_slots; s ++) {
+    if (batch_start_next(cmd, multi, slots[s], items, count, &next_item, &slot_item[s])) {
+      in_flight ++;
+    }
+  }
+
+  for (;;) {
+    // Hand out everything that is complete and in order
+    while (next_deliver < count && items[next_deliver].done) {
+      aic_batch_item_t *item = &items[next_deliver];
+      if (item->answer) nr_ok ++;
+      if (on_result) on_result(next_deliver, item->answer, userp);
+      else free(item->answer);
+      item->answer = NULL;
+      next_deliver ++;
+    }
+    if (in_flight == 0) break;
+
+    int running = 0;
+    curl_multi_perform(multi, &running);
+
+    CURLMsg *msg;
+    int nr_msgs;
+    while ((msg = curl_multi_info_read(multi, &nr_msgs)) != NULL) {
+      if (msg->msg != CURLMSG_DONE) continue;
+
+      CURL *curl = msg->easy_handle;
+      void *priv = NULL;
+      curl_easy_getinfo(curl, CURLINFO_PRIVATE, &priv);
+      int s = (int)(intptr_t)priv;
+      aic_batch_item_t *item = &items[slot_item[s]];
+
+      long status = 0;
+      CURLcode res = msg->data.result;
+      curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+      record_timing(curl, &item->req);
+      if (res != CURLE_OK) {
+        Log(ANSI_FMT("Batch item %d failed: %s", ANSI_FG_RED), slot_item[s],
+            curl_easy_strerror(res));
+      } else {
+        if (cmd == AIC_CMD_TASK_ADD && !item->correcting) {
+          pthread_mutex_lock(&local_lock);
+          local_stats.remote ++;
+          local_stats.remote_us += now_us() - item->req.start_us;
+          pthread_mutex_unlock(&local_lock);
+        }
+        if (status < 400) {
+          item->answer = parse_response(item->req.raw.memory ? item->req.raw.memory : "", &item->req);
+        }
+        if (item->answer && cmd_schema[cmd]) {
+          // As validate_answer(), but a correction is sent from this slot
+          // like any other transfer instead of blocking the whole batch
+          char err[256];
+          bool clean = false;
+          char *json = checked_json(cmd, item->answer, &clean, err, sizeof(err));
+          if (json == NULL && !item->correcting) {
+            log_write("[aic] %s: batch item %d rejected (%s), asking for a correction\n",
+                aic_cmd_name(cmd), slot_item[s], err);
+            lat_record(cmd, now_us() - item->req.start_us,
+                item->req.first_byte_us ? item->req.first_byte_us - item->req.start_us : 0);
+            record_usage(cmd, item->estimated, &item->req);
+            lat_count_request(cmd, false);
+
+            aic_prompt_t *retry = correction_prompt(strdup(prompts[slot_item[s]]), item->answer, err);
+            SAFE_FREE(item->json);
+            item->json = rope_request_json(&routes[cmd], retry);
+            if (!item->json) panic("Memory allocation failed for correction request.");
+            item->estimated = routes[cmd].system_tokens + aic_prompt_tokens(retry) + TOK_REQUEST_OVERHEAD;
+            aic_prompt_free(retry);
+            SAFE_FREE(item->answer);
+            SAFE_FREE(item->req.raw.memory);
+            item->req.raw.size = 0;
+            item->req.first_byte_us = 0;
+            item->correcting = true;
+            item->attempts = 0;
+            curl_multi_remove_handle(multi, curl);
+            prepare_request(curl, &(aic_body_t){ .json = item->json, .route = &routes[cmd] }, &item->req);
+            curl_multi_add_handle(multi, curl);
+            continue;
+          }
+          if (json == NULL) {
+            Log(ANSI_FMT("AI answer for %s rejected: %s", ANSI_FG_RED), aic_cmd_name(cmd), err);
+          }
+          // A correction is counted once the item is done, answered or not
+          if (!item->correcting) count_json_answer(cmd, clean, false, true);
+          free(item->answer);
+          item->answer = json;
+        }
+        if (item->answer && ttl != AIC_TTL_NONE) rc_put(item->key, item->answer, ttl);
+      }
+      if (item->answer) {
+        lat_record(cmd, now_us() - item->req.start_us,
+            item->req.first_byte_us ? item->req.first_byte_us - item->req.start_us : 0);
+        record_usage(cmd, item->estimated, &item->req);
+      }
+      lat_count_request(cmd, item->answer == NULL);
+      SAFE_FREE(item->req.raw.memory);
+      item->req.raw.size = 0;
+      item->req.first_byte_us = 0;
+      curl_multi_remove_handle(multi, curl);
+
+      // Transient failure: the slot keeps the item and retries it after a backoff
+      if (!item->answer && item->attempts < policy.max_retries && is_retryable(res, status)) {
+        long delay = backoff_ms(item->attempts, retry_after_ms(curl));
+        log_write("[aic] batch item %d failed, retry %d/%d in %ld ms\n", slot_item[s],
+            item->attempts + 1, policy.max_retries, delay);
+        item->attempts ++;
+        lat_count_retry(cmd);
+        slot_retry_at[s] = now_us() + (int64_t)delay * 1000;
+        continue;
+      }
+
+      if (item->correcting) count_json_answer(cmd, false, true, item->answer != NULL);
+      item->done = true;
+      in_flight --;
+      if (batch_start_next(cmd, multi, curl, items, count, &next_item, &slot_item[s])) {
+        in_flight ++;
+      }
+    }
+
+    // Restart retries that are due; wake up in time for the next one
+    int timeout_ms = 1000;
+    int64_t now = now_us();
+    for (int s = 0; s < nr_slots; s ++) {
+      if (slot_retry_at[s] == 0) continue;
+      if (slot_retry_at[s] <= now) {
+        slot_retry_at[s] = 0;
+        aic_body_t body = { .json = items[slot_item[s]].json, .route = &routes[cmd] };
+        prepare_request(slots[s], &body, &items[slot_item[s]].req);
+        curl_multi_add_handle(multi, slots[s]);
+      } else if ((slot_retry_at[s] - now) / 1000 < timeout_ms) {
+        timeout_ms = (int)((slot_retry_at[s] - now) / 1000);
+      }
+    }
+
+    if (in_flight > 0) curl_multi_poll(multi, NULL, 0, timeout_ms, NULL);
+  }
+
+  // Anything left was never started (no usable handle); report it as failed
+  for (; next_deliver < count; next_deliver ++) {
+    if (on_result) on_result(next_deliver, NULL, userp);
+  }
+
+  for (int s = 0; s < nr_slots; s ++) curl_easy_cleanup(slots[s]);
+  curl_multi_cleanup(multi);
+  for (int i = 0; i < count; i ++) SAFE_FREE(items[i].json);
+  free(items);
+  free(slots);
+  free(slot_item);
+  free(slot_retry_at);
+  return nr_ok;
+}
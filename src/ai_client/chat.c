@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "common.h"
+#include "ai_client.h"
+#include "rope.h"
+
+#define SUMMARY_HEADING "Summary of our conversation so far:\n"
+#define SUMMARY_ACK     "OK."
+
+// Role markers the chat template wraps around every message
+#define MESSAGE_OVERHEAD 4
+
+// Characters of each turn kept by the local fallback summary
+#define FALLBACK_TURN_CHARS 200
+
+typedef struct {
+  char *user;
+  char *answer;
+  size_t tokens;
+} chat_turn_t;
+
+struct aic_chat {
+  char *summary;        // older turns folded together, NULL if none yet
+  size_t summary_tokens;
+  chat_turn_t *turns;   // kept verbatim, oldest first
+  int nr_turns;
+  int cap;
+  size_t turn_tokens;   // sum over turns
+  int compactions;
+};
+
+static size_t text_tokens(const char *s) {
+  return s ? aic_estimate_tokens(s, strlen(s)) : 0;
+}
+
+aic_chat_t *aic_chat_new(void) {
+  aic_chat_t *chat = calloc(1, sizeof(aic_chat_t));
+  if (!chat) panic("Memory allocation failed for chat session.");
+  return chat;
+}
+
+static void set_summary(aic_chat_t *chat, char *summary) {
+  free(chat->summary);
+  chat->summary = summary;
+  chat->summary_tokens = summary ? text_tokens(SUMMARY_HEADING) + text_tokens(summary) +
+                                   text_tokens(SUMMARY_ACK) + 2 * MESSAGE_OVERHEAD : 0;
+}
+
+// Drops the n oldest turns
+static void drop_turns(aic_chat_t *chat, int n) {
+  for (int i = 0; i < n; i ++) {
+    free(chat->turns[i].user);
+    free(chat->turns[i].answer);
+    chat->turn_tokens -= chat->turns[i].tokens;
+  }
+  memmove(chat->turns, chat->turns + n, (chat->nr_turns - n) * sizeof(chat_turn_t));
+  chat->nr_turns -= n;
+}
+
+void aic_chat_forget(aic_chat_t *chat) {
+  drop_turns(chat, chat->nr_turns);
+  set_summary(chat, NULL);
+}
+
+void aic_chat_free(aic_chat_t *chat) {
+  if (!chat) return;
+  aic_chat_forget(chat);
+  free(chat->turns);
+  free(chat);
+}
+
+// Appends text, cut to at most max bytes (at a UTF-8 boundary) when max > 0
+static void append_text(MemoryStruct_t *m, const char *text, size_t max) {
+  size_t len = strlen(text);
+  bool cut = max > 0 && len > max;
+  if (cut) {
+    len = max;
+    while (len > 0 && ((unsigned char)text[len] & 0xc0) == 0x80) len --;
+  }
+  char *p = realloc(m->memory, m->size + len + 4);
+  if (!p) panic("Memory allocation failed for chat summary.");
+  m->memory = p;
+  memcpy(m->memory + m->size, text, len);
+  m->size += len;
+  if (cut) {
+    memcpy(m->memory + m->size, "...", 3);
+    m->size += 3;
+  }
+  m->memory[m->size] = '\0';
+}
+
+// Input of the summary request, or of the local fallback: the old summary
+// followed by the turns being folded in
+static char *fold_text(const aic_chat_t *chat, int n, size_t turn_chars) {
+  MemoryStruct_t m = { NULL, 0 };
+  append_text(&m, "", 0);
+  if (chat->summary) {
+    append_text(&m, chat->summary, 0);
+    append_text(&m, "\n", 0);
+  }
+  for (int i = 0; i < n; i ++) {
+    append_text(&m, "User: ", 0);
+    append_text(&m, chat->turns[i].user, turn_chars);
+    append_text(&m, "\nAssistant: ", 0);
+    append_text(&m, chat->turns[i].answer, turn_chars);
+    append_text(&m, "\n", 0);
+  }
+  return m.memory;
+}
+
+static const char *SUMMARY_PROMPT =
+  "### Summary So Far and Turns to Add\n"
+  "%s\n"
+  "### Updated Summary (at most %zu words)\n";
+
+/**
+ * Folds the oldest turns into the summary until the history is back to half
+ * the budget, so a long conversation is compacted every few turns instead of
+ * on each one: between compactions the request only grows at its end and the
+ * server's prefix cache keeps applying.
+ */
+static void compact(aic_chat_t *chat, size_t budget) {
+  size_t target = budget / 2;
+  size_t history = chat->summary_tokens + chat->turn_tokens;
+  int n = 0;
+
+  while (n < chat->nr_turns - AIC_CHAT_KEEP_TURNS && history > target) {
+    history -= chat->turns[n].tokens;
+    n ++;
+  }
+  if (n == 0) return;
+
+  // The summary itself may take up to a quarter of the budget
+  size_t summary_max = budget / 4;
+  char *folded = fold_text(chat, n, 0);
+  aic_prompt_t *prompt = aic_prompt_new();
+  aic_prompt_addf(prompt, SUMMARY_PROMPT, folded, summary_max / 2);
+  free(folded);
+
+  char *summary = aic_call_prompt(AIC_CMD_SUMMARY, prompt, NULL, NULL);
+  aic_prompt_free(prompt);
+
+  if (summary == NULL || text_tokens(summary) > summary_max) {
+    // Keep the beginning of every turn; the oldest go first if that is too long
+    free(summary);
+    summary = fold_text(chat, n, FALLBACK_TURN_CHARS);
+    while (summary[0] != '\0' && text_tokens(summary) > summary_max) {
+      char *nl = strchr(summary, '\n');
+      if (nl == NULL) { summary[0] = '\0'; break; }
+      memmove(summary, nl + 1, strlen(nl + 1) + 1);
+    }
+    log_write("[aic] chat: summarizing failed, kept the start of %d turns\n", n);
+  }
+
+  drop_turns(chat, n);
+  set_summary(chat, summary);
+  chat->compactions ++;
+  log_write("[aic] chat: folded %d turns into a %zu-token summary\n", n, chat->summary_tokens);
+}
+
+aic_prompt_t *aic_chat_prompt(aic_chat_t *chat, const char *input) {
+  size_t budget = aic_get_token_budget(AIC_CMD_CHAT);
+  if (input == NULL) return NULL;
+
+  if (budget > 0 && chat->summary_tokens + chat->turn_tokens + text_tokens(input) > budget) {
+    compact(chat, budget);
+  }
+
+  // Pieces are copied: a background job may still hold this prompt when a
+  // later turn compacts the history
+  aic_prompt_t *prompt = aic_prompt_new();
+  if (chat->summary) {
+    aic_prompt_add(prompt, SUMMARY_HEADING);
+    aic_prompt_add_owned(prompt, strdup(chat->summary));
+    rope_add_raw(prompt, ROPE_TO_ASSISTANT);
+    aic_prompt_add(prompt, SUMMARY_ACK);
+    rope_add_raw(prompt, ROPE_TO_USER);
+  }
+  for (int i = 0; i < chat->nr_turns; i ++) {
+    aic_prompt_add_owned(prompt, strdup(chat->turns[i].user));
+    rope_add_raw(prompt, ROPE_TO_ASSISTANT);
+    aic_prompt_add_owned(prompt, strdup(chat->turns[i].answer));
+    rope_add_raw(prompt, ROPE_TO_USER);
+  }
+  aic_prompt_add_owned(prompt, strdup(input));
+  return prompt;
+}
+
+void aic_chat_commit(aic_chat_t *chat, const char *input, const char *answer) {
+  if (chat->nr_turns == chat->cap) {
+    chat->cap = chat->cap ? chat->cap * 2 : 8;
+    chat->turns = realloc(chat->turns, chat->cap * sizeof(chat_turn_t));
+    if (!chat->turns) panic("Memory allocation failed for chat session.");
+  }
+  chat_turn_t *t = &chat->turns[chat->nr_turns ++];
+  t->user = strdup(input);
+  t->answer = strdup(answer);
+  if (!t->user || !t->answer) panic("Memory allocation failed for chat session.");
+  t->tokens = text_tokens(input) + text_tokens(answer) + 2 * MESSAGE_OVERHEAD;
+  chat->turn_tokens += t->tokens;
+}
+
+void aic_chat_get_stats(const aic_chat_t *chat, aic_chat_stats_t *st) {
+  st->turns = chat->nr_turns;
+  st->compactions = chat->compactions;
+  st->summary_tokens = chat->summary_tokens;
+  st->history_tokens = chat->summary_tokens + chat->turn_tokens;
+}
+
+const char *aic_chat_summary(const aic_chat_t *chat) {
+  return chat->summary;
+}
+
+int aic_chat_turn(const aic_chat_t *chat, int i, const char **user, const char **answer) {
+  if (i < 0 || i >= chat->nr_turns) return -1;
+  *user = chat->turns[i].user;
+  *answer = chat->turns[i].answer;
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include <ctype.h>
+#include <string.h>
+#include "common.h"
+#include "json_reply.h"
+#include "cJSON.h"
+
+// Deepest nesting followed; deeper candidates are skipped
+#define MAX_DEPTH 64
+
+// Length of the balanced value starting at s ('{' or '['), 0 if it never closes
+static size_t balanced_len(const char *s) {
+  char stack[MAX_DEPTH];
+  int depth = 0;
+  bool in_string = false;
+
+  for (const char *p = s; *p; p ++) {
+    if (in_string) {
+      if (*p == '\\' && p[1] != '\0') p ++;
+      else if (*p == '"') in_string = false;
+      continue;
+    }
+    switch (*p) {
+      case '"':
+        in_string = true;
+        break;
+      case '{':
+      case '[':
+        if (depth == MAX_DEPTH) return 0;
+        stack[depth ++] = (*p == '{') ? '}' : ']';
+        break;
+      case '}':
+      case ']':
+        if (depth == 0 || stack[depth - 1] != *p) return 0;
+        if (-- depth == 0) return p - s + 1;
+        break;
+    }
+  }
+  return 0;
+}
+
+static bool only_space(const char *s, size_t len) {
+  for (size_t i = 0; i < len; i ++) {
+    if (!isspace((unsigned char)s[i])) return false;
+  }
+  return true;
+}
+
+char *jr_extract(const char *reply, bool object, bool *clean) {
+  *clean = false;
+  if (reply == NULL) return NULL;
+
+  for (const char *p = reply; (p = strchr(p, object ? '{' : '[')) != NULL; p ++) {
+    size_t len = balanced_len(p);
+    if (len == 0) continue;
+
+    cJSON *value = cJSON_ParseWithLength(p, len);
+    if (value == NULL) continue;
+    cJSON_Delete(value);
+
+    char *json = malloc(len + 1);
+    if (!json) panic("Memory allocation failed for JSON answer.");
+    memcpy(json, p, len);
+    json[len] = '\0';
+    *clean = only_space(reply, p - reply) && only_space(p + len, strlen(p + len));
+    return json;
+  }
+  return NULL;
+}
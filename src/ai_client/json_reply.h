@@ -0,0 +1,17 @@
+#ifndef __JSON_REPLY_H__
+#define __JSON_REPLY_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * @brief Finds the JSON value in a model reply.
+ * * Returns the first balanced object (or array) that parses, skipping prose,
+ *   code fences and other brackets around it ("Options [1,2]: ```json\n{...}\n```").
+ * @param object true to look for an object, false for an array.
+ * @param clean Set to whether the reply was that value alone (whitespace aside).
+ * @return A copy of the value the caller frees, or NULL if there is none.
+ */
+char *jr_extract(const char *reply, bool object, bool *clean);
+
+#endif
@@ -0,0 +1,111 @@
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include "latency.h"
+
+// Ring buffers of the latest successful requests of one command
+typedef struct {
+  int64_t total[AIC_LATENCY_WINDOW];
+  int64_t first[AIC_LATENCY_WINDOW];
+  int nr_samples;
+  int next;
+  uint64_t requests, failures, retries, hedges, hedge_wins, coalesced;
+} lat_window_t;
+
+static lat_window_t windows[NR_AIC_CMD];
+static pthread_mutex_t lat_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int cmp_int64(const void *a, const void *b) {
+  int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile; sorts values in place
+static int64_t percentile(int64_t *values, int n, int pct) {
+  if (n == 0) return 0;
+  qsort(values, n, sizeof(int64_t), cmp_int64);
+  int rank = (pct * n + 99) / 100;
+  return values[rank > 0 ? rank - 1 : 0];
+}
+
+void lat_record(aic_cmd_e cmd, int64_t total_us, int64_t first_byte_us) {
+  lat_window_t *w = &windows[cmd];
+  pthread_mutex_lock(&lat_lock);
+  w->total[w->next] = total_us;
+  w->first[w->next] = first_byte_us;
+  w->next = (w->next + 1) % AIC_LATENCY_WINDOW;
+  if (w->nr_samples < AIC_LATENCY_WINDOW) w->nr_samples ++;
+  pthread_mutex_unlock(&lat_lock);
+}
+
+void lat_count_request(aic_cmd_e cmd, bool failed) {
+  pthread_mutex_lock(&lat_lock);
+  windows[cmd].requests ++;
+  if (failed) windows[cmd].failures ++;
+  pthread_mutex_unlock(&lat_lock);
+}
+
+void lat_count_retry(aic_cmd_e cmd) {
+  pthread_mutex_lock(&lat_lock);
+  windows[cmd].retries ++;
+  pthread_mutex_unlock(&lat_lock);
+}
+
+void lat_count_hedge(aic_cmd_e cmd) {
+  pthread_mutex_lock(&lat_lock);
+  windows[cmd].hedges ++;
+  pthread_mutex_unlock(&lat_lock);
+}
+
+void lat_count_hedge_win(aic_cmd_e cmd) {
+  pthread_mutex_lock(&lat_lock);
+  windows[cmd].hedge_wins ++;
+  pthread_mutex_unlock(&lat_lock);
+}
+
+void lat_count_coalesced(aic_cmd_e cmd) {
+  pthread_mutex_lock(&lat_lock);
+  windows[cmd].coalesced ++;
+  pthread_mutex_unlock(&lat_lock);
+}
+
+int64_t lat_hedge_delay_us(aic_cmd_e cmd) {
+  int64_t values[AIC_LATENCY_WINDOW];
+  int64_t delay = -1;
+
+  pthread_mutex_lock(&lat_lock);
+  int n = windows[cmd].nr_samples;
+  if (n >= AIC_HEDGE_MIN_SAMPLES) {
+    memcpy(values, windows[cmd].first, n * sizeof(int64_t));
+  }
+  pthread_mutex_unlock(&lat_lock);
+
+  if (n >= AIC_HEDGE_MIN_SAMPLES) delay = percentile(values, n, 95);
+  return delay;
+}
+
+void lat_get(aic_cmd_e cmd, aic_latency_t *lat) {
+  int64_t total[AIC_LATENCY_WINDOW], first[AIC_LATENCY_WINDOW];
+
+  memset(lat, 0, sizeof(*lat));
+  pthread_mutex_lock(&lat_lock);
+  lat_window_t *w = &windows[cmd];
+  int n = w->nr_samples;
+  memcpy(total, w->total, n * sizeof(int64_t));
+  memcpy(first, w->first, n * sizeof(int64_t));
+  lat->requests = w->requests;
+  lat->failures = w->failures;
+  lat->retries = w->retries;
+  lat->hedges = w->hedges;
+  lat->hedge_wins = w->hedge_wins;
+  lat->coalesced = w->coalesced;
+  pthread_mutex_unlock(&lat_lock);
+
+  lat->samples = n;
+  lat->p50_us = percentile(total, n, 50);
+  lat->p95_us = percentile(total, n, 95);
+  lat->p99_us = percentile(total, n, 99);
+  lat->first_p50_us = percentile(first, n, 50);
+  lat->first_p95_us = percentile(first, n, 95);
+  lat->first_p99_us = percentile(first, n, 99);
+}
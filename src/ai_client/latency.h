@@ -0,0 +1,24 @@
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include "ai_client.h"
+
+// Per-command latency windows and retry/hedge counters (thread-safe)
+
+void lat_record(aic_cmd_e cmd, int64_t total_us, int64_t first_byte_us);
+void lat_count_request(aic_cmd_e cmd, bool failed);
+void lat_count_retry(aic_cmd_e cmd);
+void lat_count_hedge(aic_cmd_e cmd);
+void lat_count_hedge_win(aic_cmd_e cmd);
+// A call that waited for an identical request already in flight
+void lat_count_coalesced(aic_cmd_e cmd);
+
+/**
+ * @brief Time to wait for a first byte before hedging: the p95 of the window.
+ * @return The delay in microseconds, or -1 while there are too few samples.
+ */
+int64_t lat_hedge_delay_us(aic_cmd_e cmd);
+
+void lat_get(aic_cmd_e cmd, aic_latency_t *lat);
+
+#endif
@@ -0,0 +1,705 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include "local_parser.h"
+
+// Rule-based parser for the common shapes of "task add" input.
+// The input is scanned left to right; every recognised date, time or priority
+// phrase is blanked out, and whatever is left must be a plain title. Anything
+// ambiguous (an hour without am/pm, "下午" without an hour, two dates, stray
+// numbers, a priority word inside a longer word, no phrase at all) makes the
+// parser give up so that the model handles it.
+
+enum { DAY_NONE, DAY_OFFSET, DAY_WEEKDAY, DAY_DATE };
+enum { PART_NONE, PART_AM, PART_NOON, PART_PM };
+
+typedef struct {
+  char buf[LP_INPUT_MAX];
+  bool used[LP_INPUT_MAX];
+  size_t len;
+
+  int day_kind;
+  int offset;           // DAY_OFFSET: days from today
+  int weekday;          // DAY_WEEKDAY: 0 = Sunday
+  bool next_week;
+  int month, mday;      // DAY_DATE, month 0 if not given
+  bool has_time;
+  int hour, minute;
+  int part;
+  int prio;             // -1 if not given
+  bool conflict;
+} lp_state_t;
+
+typedef struct {
+  const char *word;
+  int value;
+} lp_word_t;
+
+// Ordered so that longer phrases are tried before their substrings
+static const lp_word_t cn_prio[] = {
+  { "非常紧急", 0 }, { "最高优先级", 0 }, { "不紧急", 3 }, { "不重要", 3 },
+  { "紧急", 0 }, { "立刻", 0 }, { "马上", 0 },
+  { "高优先级", 1 }, { "重要", 1 }, { "尽快", 1 },
+  { "低优先级", 3 }, { "有空再做", 3 }, { "不急", 3 },
+  { "正常", 2 }, { "中等", 2 },
+};
+
+static const lp_word_t en_prio[] = {
+  { "not urgent", 3 }, { "low priority", 3 }, { "urgent", 0 }, { "asap", 0 },
+  { "high priority", 1 }, { "important", 1 }, { "normal priority", 2 },
+};
+
+static const lp_word_t cn_days[] = {
+  { "大后天", 3 }, { "后天", 2 }, { "明天", 1 }, { "明日", 1 }, { "今天", 0 }, { "今日", 0 },
+};
+
+static const lp_word_t en_days[] = {
+  { "day after tomorrow", 2 }, { "tomorrow", 1 }, { "today", 0 },
+};
+
+// Day words that also fix the part of the day
+static const struct { const char *word; int offset; int part; } day_parts[] = {
+  { "今晚", 0, PART_PM }, { "明晚", 1, PART_PM }, { "明早", 1, PART_AM }, { "tonight", 0, PART_PM },
+};
+
+static const lp_word_t cn_parts[] = {
+  { "上午", PART_AM }, { "早上", PART_AM }, { "早晨", PART_AM }, { "中午", PART_NOON },
+  { "下午", PART_PM }, { "傍晚", PART_PM }, { "晚上", PART_PM },
+};
+
+static const char *cn_week_prefix[] = { "下礼拜", "下星期", "下周", "本周", "这周", "礼拜", "星期", "周" };
+static const char *cn_weekdays[] = { "日", "一", "二", "三", "四", "五", "六", "天" };
+
+static const lp_word_t en_weekdays[] = {
+  { "sunday", 0 }, { "monday", 1 }, { "tuesday", 2 }, { "wednesday", 3 },
+  { "thursday", 4 }, { "friday", 5 }, { "saturday", 6 },
+};
+
+// Also ordinary words ("sun cream", "SAT practice"), see match_weekday()
+static const lp_word_t en_weekday_abbrs[] = {
+  { "tues", 2 }, { "thurs", 4 }, { "thur", 4 },
+  { "sun", 0 }, { "mon", 1 }, { "tue", 2 }, { "wed", 3 }, { "thu", 4 }, { "fri", 5 }, { "sat", 6 },
+};
+
+static const char *cn_punct[] = { "，", "。", "、", "：", "；", "！", "？" };
+
+static const char *en_connectors[] = { "at", "on", "by", "before", "due", "in" };
+
+// Leftovers that mean a date or time phrase was not fully understood
+static const char *cn_leftovers[] = {
+  "下周", "本周", "这周", "下星期", "下礼拜", "星期", "礼拜", "下个月", "下月", "本月", "月底", "月初",
+  "年底", "凌晨", "小时", "分钟", "每天", "每周", "之前", "以前", "之后", "以后", "截止", "优先级",
+};
+static const char *en_leftovers[] = {
+  "am", "pm", "morning", "afternoon", "evening", "night", "noon", "week", "weeks", "weekend",
+  "month", "months", "day", "days", "hour", "hours", "minutes", "tomorrow", "today", "tonight",
+  "next", "eod", "deadline", "priority",
+};
+
+static const char *cn_digits[] = { "零", "一", "二", "三", "四", "五", "六", "七", "八", "九" };
+
+static bool has_prefix(const lp_state_t *s, size_t i, const char *word) {
+  size_t n = strlen(word);
+  if (i + n > s->len || memcmp(s->buf + i, word, n) != 0) return false;
+  for (size_t k = i; k < i + n; k ++) {
+    if (s->used[k]) return false;
+  }
+  return true;
+}
+
+static bool is_word_char(char c) {
+  return isalnum((unsigned char)c) || c == '\'';
+}
+
+// Case-insensitive whole-word match of an English phrase at i
+static size_t match_en(const lp_state_t *s, size_t i, const char *word) {
+  size_t n = strlen(word);
+  if (i + n > s->len || strncasecmp(s->buf + i, word, n) != 0) return 0;
+  if (i > 0 && is_word_char(s->buf[i - 1])) return 0;
+  if (i + n < s->len && is_word_char(s->buf[i + n])) return 0;
+  for (size_t k = i; k < i + n; k ++) {
+    if (s->used[k]) return 0;
+  }
+  return n;
+}
+
+// True if position i, looking back (before) or ahead, meets the start or end
+// of the input, whitespace, punctuation or an already recognised phrase
+static bool at_boundary(const lp_state_t *s, size_t i, bool before) {
+  if (before ? i == 0 : i >= s->len) return true;
+  size_t k = before ? i - 1 : i;
+  if (s->used[k]) return true;
+  if ((unsigned char)s->buf[k] < 0x80) return !is_word_char(s->buf[k]);
+  for (size_t m = 0; m < sizeof(cn_punct) / sizeof(cn_punct[0]); m ++) {
+    if (before ? i >= 3 && memcmp(s->buf + i - 3, cn_punct[m], 3) == 0
+               : i + 3 <= s->len && memcmp(s->buf + i, cn_punct[m], 3) == 0) return true;
+  }
+  return false;
+}
+
+// True if a phrase from..to starts or ends its clause ("urgent: fix login",
+// "fix login, urgent"), not sitting between two words ("an important meeting")
+static bool at_clause_edge(const lp_state_t *s, size_t from, size_t to) {
+  while (from > 0 && (s->buf[from - 1] == ' ' || s->used[from - 1])) from --;
+  while (to < s->len && s->buf[to] == ' ') to ++;
+  return at_boundary(s, from, true) || at_boundary(s, to, false);
+}
+
+static size_t skip_spaces(const lp_state_t *s, size_t i) {
+  while (i < s->len && s->buf[i] == ' ') i ++;
+  return i;
+}
+
+static void consume(lp_state_t *s, size_t from, size_t to) {
+  for (size_t k = from; k < to; k ++) s->used[k] = true;
+}
+
+// Reads an ASCII or Chinese numeral (up to 99) at i; returns its length
+static size_t parse_number(const lp_state_t *s, size_t i, int *value) {
+  size_t p = i;
+  int v = 0;
+
+  if (p < s->len && isdigit((unsigned char)s->buf[p])) {
+    while (p < s->len && isdigit((unsigned char)s->buf[p]) && p - i < 4) {
+      v = v * 10 + (s->buf[p ++] - '0');
+    }
+    *value = v;
+    return p - i;
+  }
+
+  int tens = -1, units = -1;
+  for (;;) {
+    int d = -1;
+    for (int k = 0; k < 10; k ++) {
+      if (has_prefix(s, p, cn_digits[k])) { d = k; break; }
+    }
+    if (d < 0 && has_prefix(s, p, "两")) d = 2;
+
+    if (d >= 0 && units < 0) {
+      units = d;
+      p += 3;
+    } else if (has_prefix(s, p, "十") && tens < 0) {
+      tens = (units < 0 ? 1 : units);
+      units = -1;
+      p += 3;
+    } else {
+      break;
+    }
+  }
+  if (p == i) return 0;
+  *value = (tens < 0 ? 0 : tens * 10) + (units < 0 ? 0 : units);
+  return p - i;
+}
+
+static void set_day(lp_state_t *s, int kind) {
+  if (s->day_kind != DAY_NONE) s->conflict = true;
+  s->day_kind = kind;
+}
+
+static void set_part(lp_state_t *s, int part) {
+  if (s->part != PART_NONE && s->part != part) s->conflict = true;
+  s->part = part;
+}
+
+static void set_time(lp_state_t *s, int hour, int minute) {
+  if (s->has_time || hour > 23 || minute > 59) s->conflict = true;
+  s->has_time = true;
+  s->hour = hour;
+  s->minute = minute;
+}
+
+static void set_prio(lp_state_t *s, int prio) {
+  if (s->prio >= 0 && s->prio != prio) s->conflict = true;
+  s->prio = prio;
+}
+
+// Matches word at i: whole-word and case-insensitive for English, exact otherwise
+static size_t match_word(const lp_state_t *s, size_t i, const char *word) {
+  if (isalpha((unsigned char)word[0])) return match_en(s, i, word);
+  return has_prefix(s, i, word) ? strlen(word) : 0;
+}
+
+// "at 3pm", "on Friday", "在明天": the connector belongs to the phrase
+static void consume_connector_before(lp_state_t *s, size_t i) {
+  size_t end = i;
+  while (end > 0 && s->buf[end - 1] == ' ' && !s->used[end - 1]) end --;
+  if (end >= 3 && memcmp(s->buf + end - 3, "在", 3) == 0 && !s->used[end - 3]) {
+    consume(s, end - 3, i);
+    return;
+  }
+  for (size_t k = 0; k < sizeof(en_connectors) / sizeof(en_connectors[0]); k ++) {
+    size_t n = strlen(en_connectors[k]);
+    if (end >= n && match_en(s, end - n, en_connectors[k])) {
+      consume(s, end - n, i);
+      return;
+    }
+  }
+}
+
+// "周五前", "明天之前": a deadline marker right after a date
+static size_t consume_before_marker(lp_state_t *s, size_t i) {
+  static const char *markers[] = { "之前", "以前", "前" };
+  for (int k = 0; k < 3; k ++) {
+    if (has_prefix(s, i, markers[k])) {
+      size_t n = strlen(markers[k]);
+      consume(s, i, i + n);
+      return i + n;
+    }
+  }
+  return i;
+}
+
+// "am"/"pm" right after a number ("3pm", "10:30 am")
+static int match_ampm(const lp_state_t *s, size_t i) {
+  if (i + 2 > s->len || (i + 2 < s->len && is_word_char(s->buf[i + 2]))) return PART_NONE;
+  if (s->used[i] || s->used[i + 1]) return PART_NONE;
+  if (strncasecmp(s->buf + i, "am", 2) == 0) return PART_AM;
+  if (strncasecmp(s->buf + i, "pm", 2) == 0) return PART_PM;
+  return PART_NONE;
+}
+
+// Numbers followed by a unit: times, day offsets and calendar dates
+static size_t match_number(lp_state_t *s, size_t i) {
+  int n, m;
+  size_t len = parse_number(s, i, &n);
+  if (len == 0) return 0;
+  size_t p = i + len;
+
+  if (has_prefix(s, p, "点半")) {
+    set_time(s, n, 30);
+    return p + strlen("点半") - i;
+  }
+  if (has_prefix(s, p, "点钟")) {
+    set_time(s, n, 0);
+    return p + strlen("点钟") - i;
+  }
+  if (has_prefix(s, p, "点")) {
+    p += strlen("点");
+    size_t mlen = parse_number(s, p, &m);
+    if (mlen > 0 && has_prefix(s, p + mlen, "分")) {
+      set_time(s, n, m);
+      return p + mlen + strlen("分") - i;
+    }
+    set_time(s, n, 0);
+    return p - i;
+  }
+  if (p < s->len && s->buf[p] == ':' && isdigit((unsigned char)s->buf[p + 1]) &&
+      isdigit((unsigned char)s->buf[p + 2])) {
+    set_time(s, n, (s->buf[p + 1] - '0') * 10 + (s->buf[p + 2] - '0'));
+    p += 3;
+    size_t q = skip_spaces(s, p);
+    int part = match_ampm(s, q);
+    if (part != PART_NONE) {
+      set_part(s, part);
+      return q + 2 - i;
+    }
+    return p - i;
+  }
+  size_t q = skip_spaces(s, p);
+  int part = match_ampm(s, q);
+  if (part != PART_NONE) {
+    set_time(s, n, 0);
+    set_part(s, part);
+    return q + 2 - i;
+  }
+
+  static const char *after_days[] = { "天之后", "天以后", "天后" };
+  for (int k = 0; k < 3; k ++) {
+    if (has_prefix(s, p, after_days[k])) {
+      set_day(s, DAY_OFFSET);
+      s->offset = n;
+      return p + strlen(after_days[k]) - i;
+    }
+  }
+  if (has_prefix(s, p, "周后") || has_prefix(s, p, "星期后")) {
+    set_day(s, DAY_OFFSET);
+    s->offset = 7 * n;
+    return p + strlen(has_prefix(s, p, "周后") ? "周后" : "星期后") - i;
+  }
+  if (has_prefix(s, p, "月")) {
+    size_t r = p + strlen("月");
+    size_t dlen = parse_number(s, r, &m);
+    if (dlen > 0 && (has_prefix(s, r + dlen, "日") || has_prefix(s, r + dlen, "号"))) {
+      set_day(s, DAY_DATE);
+      s->month = n;
+      s->mday = m;
+      return r + dlen + 3 - i;
+    }
+    return 0;
+  }
+  if (has_prefix(s, p, "号") || has_prefix(s, p, "日")) {
+    set_day(s, DAY_DATE);
+    s->month = 0;
+    s->mday = n;
+    return p + 3 - i;
+  }
+  return 0;
+}
+
+// A weekday name at i. Abbreviations only count after next/this/on/by
+// (prefixed) or as the last word, and only as "fri" or "Fri", not "FRI"
+static size_t match_weekday(const lp_state_t *s, size_t i, bool prefixed, int *weekday) {
+  size_t w;
+
+  for (size_t k = 0; k < sizeof(en_weekdays) / sizeof(en_weekdays[0]); k ++) {
+    if ((w = match_en(s, i, en_weekdays[k].word)) != 0) {
+      *weekday = en_weekdays[k].value;
+      return w;
+    }
+  }
+  for (size_t k = 0; k < sizeof(en_weekday_abbrs) / sizeof(en_weekday_abbrs[0]); k ++) {
+    if ((w = match_en(s, i, en_weekday_abbrs[k].word)) == 0) continue;
+    for (size_t c = 1; c < w; c ++) {
+      if (!islower((unsigned char)s->buf[i + c])) return 0;
+    }
+    if (!prefixed) {
+      size_t end = i + w;
+      while (end < s->len && !is_word_char(s->buf[end]) && (unsigned char)s->buf[end] < 0x80) end ++;
+      if (end < s->len) return 0;
+    }
+    *weekday = en_weekday_abbrs[k].value;
+    return w;
+  }
+  return 0;
+}
+
+static size_t match_english_phrases(lp_state_t *s, size_t i) {
+  size_t n;
+
+  // "in 3 days", "in 2 weeks"
+  if ((n = match_en(s, i, "in")) != 0) {
+    int v;
+    size_t p = skip_spaces(s, i + n);
+    size_t len = parse_number(s, p, &v);
+    if (len > 0) {
+      size_t q = skip_spaces(s, p + len);
+      static const lp_word_t units[] = { { "days", 1 }, { "day", 1 }, { "weeks", 7 }, { "week", 7 } };
+      for (int k = 0; k < 4; k ++) {
+        size_t u = match_en(s, q, units[k].word);
+        if (u) {
+          set_day(s, DAY_OFFSET);
+          s->offset = v * units[k].value;
+          return q + u - i;
+        }
+      }
+    }
+  }
+
+  // "next fri", "this friday", "friday"
+  size_t p = i;
+  bool next = false, prefixed = false;
+  if ((n = match_en(s, i, "next")) != 0 || (n = match_en(s, i, "this")) != 0) {
+    next = (tolower((unsigned char)s->buf[i]) == 'n');
+    prefixed = true;
+    p = skip_spaces(s, i + n);
+  } else {
+    size_t end = i;
+    while (end > 0 && s->buf[end - 1] == ' ') end --;
+    prefixed = end >= 2 && (match_en(s, end - 2, "on") || match_en(s, end - 2, "by"));
+  }
+  int weekday;
+  size_t w = match_weekday(s, p, prefixed, &weekday);
+  if (w) {
+    set_day(s, DAY_WEEKDAY);
+    s->weekday = weekday;
+    s->next_week = next;
+    return p + w - i;
+  }
+
+  if ((n = match_en(s, i, "noon")) != 0) {
+    set_time(s, 12, 0);
+    return n;
+  }
+  return 0;
+}
+
+// Tries every rule at position i; returns the number of bytes recognised
+static size_t match_at(lp_state_t *s, size_t i) {
+  size_t n;
+
+  // A priority word inside a longer word ("整理重要文件", "是否正常",
+  // "马上要考试") is part of the title; leave the whole input to the model
+  for (size_t k = 0; k < sizeof(cn_prio) / sizeof(cn_prio[0]); k ++) {
+    if ((n = match_word(s, i, cn_prio[k].word)) != 0) {
+      if (at_boundary(s, i, true) && at_boundary(s, i + n, false)) {
+        set_prio(s, cn_prio[k].value);
+      } else {
+        s->conflict = true;
+      }
+      return n;
+    }
+  }
+  for (size_t k = 0; k < sizeof(en_prio) / sizeof(en_prio[0]); k ++) {
+    if ((n = match_word(s, i, en_prio[k].word)) != 0) {
+      if (at_clause_edge(s, i, i + n)) {
+        set_prio(s, en_prio[k].value);
+      } else {
+        s->conflict = true;
+      }
+      return n;
+    }
+  }
+
+  for (size_t k = 0; k < sizeof(day_parts) / sizeof(day_parts[0]); k ++) {
+    if ((n = match_word(s, i, day_parts[k].word)) != 0) {
+      set_day(s, DAY_OFFSET);
+      s->offset = day_parts[k].offset;
+      set_part(s, day_parts[k].part);
+      return n;
+    }
+  }
+  for (size_t k = 0; k < sizeof(cn_days) / sizeof(cn_days[0]); k ++) {
+    if ((n = match_word(s, i, cn_days[k].word)) != 0) {
+      set_day(s, DAY_OFFSET);
+      s->offset = cn_days[k].value;
+      return n;
+    }
+  }
+  for (size_t k = 0; k < sizeof(en_days) / sizeof(en_days[0]); k ++) {
+    if ((n = match_word(s, i, en_days[k].word)) != 0) {
+      set_day(s, DAY_OFFSET);
+      s->offset = en_days[k].value;
+      return n;
+    }
+  }
+
+  for (size_t k = 0; k < sizeof(cn_week_prefix) / sizeof(cn_week_prefix[0]); k ++) {
+    if (!has_prefix(s, i, cn_week_prefix[k])) continue;
+    size_t p = i + strlen(cn_week_prefix[k]);
+    for (int d = 0; d < 8; d ++) {
+      if (has_prefix(s, p, cn_weekdays[d])) {
+        set_day(s, DAY_WEEKDAY);
+        s->weekday = d % 7;
+        s->next_week = (strncmp(cn_week_prefix[k], "下", strlen("下")) == 0);
+        return p + 3 - i;
+      }
+    }
+  }
+
+  for (size_t k = 0; k < sizeof(cn_parts) / sizeof(cn_parts[0]); k ++) {
+    if (has_prefix(s, i, cn_parts[k].word)) {
+      set_part(s, cn_parts[k].value);
+      return strlen(cn_parts[k].word);
+    }
+  }
+
+  if ((n = match_number(s, i)) != 0) return n;
+  return match_english_phrases(s, i);
+}
+
+static bool is_trim_char(const char *p, size_t *n) {
+  static const char *cn_trim[] = { "，", "。", "、", "：", "；", "！", "的", "于" };
+  if (*p == ' ' || *p == ',' || *p == '.' || *p == ';' || *p == ':' || *p == '-' || *p == '!') {
+    *n = 1;
+    return true;
+  }
+  for (int k = 0; k < 8; k ++) {
+    if (strncmp(p, cn_trim[k], 3) == 0) { *n = 3; return true; }
+  }
+  return false;
+}
+
+// Drops leading/trailing punctuation and English connectors left by removed phrases
+static void trim_title(char *t) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    size_t len = strlen(t), n;
+
+    if (len > 0 && is_trim_char(t, &n)) {
+      memmove(t, t + n, len - n + 1);
+      changed = true;
+      continue;
+    }
+    if ((len >= 1 && is_trim_char(t + len - 1, &n) && n == 1) ||
+        (len >= 3 && is_trim_char(t + len - 3, &n) && n == 3)) {
+      t[len - n] = '\0';
+      changed = true;
+      continue;
+    }
+
+    for (size_t k = 0; k < sizeof(en_connectors) / sizeof(en_connectors[0]); k ++) {
+      size_t w = strlen(en_connectors[k]);
+      if (len > w && t[len - w - 1] == ' ' && strcasecmp(t + len - w, en_connectors[k]) == 0) {
+        t[len - w] = '\0';
+        changed = true;
+        break;
+      }
+    }
+  }
+}
+
+static bool contains_en_word(const char *t, const char *word) {
+  size_t n = strlen(word);
+  for (const char *p = t; *p; p ++) {
+    if (strncasecmp(p, word, n) != 0) continue;
+    if ((p == t || !is_word_char(p[-1])) && !is_word_char(p[n])) return true;
+  }
+  return false;
+}
+
+static bool title_is_clean(const char *t) {
+  if (*t == '\0') return false;
+  for (const char *p = t; *p; p ++) {
+    if (isdigit((unsigned char)*p)) return false;
+  }
+  for (size_t k = 0; k < sizeof(cn_leftovers) / sizeof(cn_leftovers[0]); k ++) {
+    if (strstr(t, cn_leftovers[k])) return false;
+  }
+  for (size_t k = 0; k < sizeof(en_leftovers) / sizeof(en_leftovers[0]); k ++) {
+    if (contains_en_word(t, en_leftovers[k])) return false;
+  }
+  // Several clauses usually carry a description the model should split out
+  static const char *clauses[] = { "，", "。", "；", "！", "？", ",", ";", "?", "!" };
+  for (int k = 0; k < 9; k ++) {
+    if (strstr(t, clauses[k])) return false;
+  }
+  return true;
+}
+
+static int resolve_hour(lp_state_t *s) {
+  int h = s->hour;
+  switch (s->part) {
+    case PART_AM:   if (h == 12) h = 0; break;
+    case PART_NOON: if (h < 6) h += 12; break;
+    case PART_PM:   if (h < 12) h += 12; break;
+    default:
+      // "3点" could be 03:00 or 15:00
+      if (h < 7) return -1;
+  }
+  return h;
+}
+
+static int resolve_due(lp_state_t *s, time_t now, time_t *due) {
+  struct tm tm;
+  localtime_r(&now, &tm);
+
+  if (s->day_kind == DAY_NONE && !s->has_time) {
+    if (s->part != PART_NONE) return -1;
+    // Same default as the add prompt: UTC midnight one week from now
+    time_t t = now + 7 * 24 * 60 * 60;
+    *due = t - t % (24 * 60 * 60);
+    return 0;
+  }
+  if (s->part != PART_NONE && !s->has_time) return -1;
+
+  int today_wday = tm.tm_wday;
+  tm.tm_hour = 0; tm.tm_min = 0; tm.tm_sec = 0;
+  tm.tm_isdst = -1;
+
+  switch (s->day_kind) {
+    case DAY_OFFSET:
+      if (s->offset > 366) return -1;
+      tm.tm_mday += s->offset;
+      break;
+    case DAY_WEEKDAY: {
+      // Weeks start on Monday: "下周五" is Friday of next week
+      int cur = (today_wday + 6) % 7, target = (s->weekday + 6) % 7;
+      tm.tm_mday += s->next_week ? 7 - cur + target : (target - cur + 7) % 7;
+      break;
+    }
+    case DAY_DATE: {
+      if (s->mday < 1 || s->mday > 31 || s->month > 12) return -1;
+      int today_mon = tm.tm_mon, today_mday = tm.tm_mday;
+      if (s->month > 0) {
+        tm.tm_mon = s->month - 1;
+        if (tm.tm_mon < today_mon || (tm.tm_mon == today_mon && s->mday < today_mday)) tm.tm_year ++;
+      } else if (s->mday < today_mday) {
+        tm.tm_mon ++;
+      }
+      tm.tm_mday = s->mday;
+      break;
+    }
+  }
+
+  if (s->has_time) {
+    int h = resolve_hour(s);
+    if (h < 0) return -1;
+    tm.tm_hour = h;
+    tm.tm_min = s->minute;
+  } else {
+    // A bare date means by the end of that day
+    tm.tm_hour = 23; tm.tm_min = 59; tm.tm_sec = 59;
+  }
+
+  int mon = tm.tm_mon;
+  time_t t = mktime(&tm);
+  if (t == (time_t)-1) return -1;
+  // mktime() rolls "2月30日" over to March 2; such a date is not understood
+  if (s->day_kind == DAY_DATE && (tm.tm_mday != s->mday || tm.tm_mon != mon % 12)) return -1;
+  if (s->day_kind == DAY_NONE && t <= now) {
+    // "3pm" after 3pm means tomorrow
+    tm.tm_mday ++;
+    tm.tm_isdst = -1;
+    t = mktime(&tm);
+  }
+  *due = t;
+  return 0;
+}
+
+int lp_parse_task(const char *input, time_t now, lp_task_t *out) {
+  lp_state_t s;
+
+  if (input == NULL) return -1;
+  memset(&s, 0, sizeof(s));
+  s.len = strlen(input);
+  if (s.len == 0 || s.len >= LP_INPUT_MAX) return -1;
+  memcpy(s.buf, input, s.len + 1);
+  for (size_t i = 0; i < s.len; i ++) {
+    if (s.buf[i] == '\t' || s.buf[i] == '\n' || s.buf[i] == '\r') s.buf[i] = ' ';
+  }
+  s.prio = -1;
+
+  for (size_t i = 0; i < s.len; ) {
+    if (s.used[i]) { i ++; continue; }
+
+    int day_kind = s.day_kind;
+    bool has_time = s.has_time;
+    size_t n = match_at(&s, i);
+    if (n == 0) {
+      // Step over a whole UTF-8 character or ASCII word
+      if ((unsigned char)s.buf[i] >= 0x80) {
+        i ++;
+        while (i < s.len && ((unsigned char)s.buf[i] & 0xc0) == 0x80) i ++;
+      } else if (is_word_char(s.buf[i])) {
+        while (i < s.len && is_word_char(s.buf[i])) i ++;
+      } else {
+        i ++;
+      }
+      continue;
+    }
+
+    consume(&s, i, i + n);
+    if (s.day_kind != day_kind || s.has_time != has_time) {
+      consume_connector_before(&s, i);
+      n = consume_before_marker(&s, i + n) - i;
+    }
+    i += n;
+    if (s.conflict) return -1;
+  }
+
+  // What is left is the title, with removed phrases collapsed to one space
+  char title[LP_INPUT_MAX];
+  size_t t = 0;
+  for (size_t i = 0; i < s.len; i ++) {
+    if (s.used[i] || s.buf[i] == ' ') {
+      if (t > 0 && title[t - 1] != ' ') title[t ++] = ' ';
+    } else {
+      title[t ++] = s.buf[i];
+    }
+  }
+  title[t] = '\0';
+  trim_title(title);
+
+  // A bare title ("buy coffee beans sometime") may still hold a date the
+  // rules do not know; only inputs with a recognised phrase are taken
+  if (s.day_kind == DAY_NONE && !s.has_time && s.part == PART_NONE && s.prio < 0) return -1;
+
+  if (!title_is_clean(title) || strlen(title) >= LP_TITLE_MAX) return -1;
+  if (resolve_due(&s, now, &out->due_date) != 0) return -1;
+
+  strcpy(out->title, title);
+  out->prio = (s.prio < 0 ? 2 : s.prio);
+  return 0;
+}
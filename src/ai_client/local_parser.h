@@ -0,0 +1,27 @@
+#ifndef __LOCAL_PARSER_H__
+#define __LOCAL_PARSER_H__
+
+#include <time.h>
+
+// Inputs longer than this always go to the model
+#define LP_INPUT_MAX 256
+#define LP_TITLE_MAX 128
+
+typedef struct {
+  char title[LP_TITLE_MAX];
+  time_t due_date;
+  int prio;
+} lp_task_t;
+
+/**
+ * @brief Parses a formulaic task description ("明天下午3点 交周报 紧急",
+ *        "submit report next Fri important") without the model.
+ * * Relative dates are resolved in local time against now. Without any date
+ *   the due date follows the add prompt's default (UTC midnight a week out).
+ * @return 0 if there was at least one date/priority phrase, every one was
+ *         understood and a clean title is left, -1 if the input should be sent
+ *         to the model instead.
+ */
+int lp_parse_task(const char *input, time_t now, lp_task_t *out);
+
+#endif
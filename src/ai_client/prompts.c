@@ -7,14 +7,28 @@
 #include <string.h>
 #include <stdlib.h>
 #include "parser.h"
+#include "tokens.h"
 
-// New template now accepts THREE format placeholders: 
-// %s (Task Input), %ld (Current Unix Time), %s (Current Human-Readable Time)
-static const char *TASK_ADD_PROMPT_TEMPLATE =
+// Context time embedded in prompts is rounded down, so identical requests made
+// close together produce byte-identical prompts and hit the response cache.
+#define PROMPT_TIME_GRANULARITY 60        // task add/update: one minute
+#define REPORT_TIME_GRANULARITY (60 * 60) // reports: one hour
+
+static time_t prompt_time(time_t granularity) {
+    time_t now = time(NULL);
+    return now - now % granularity;
+}
+
+// Every template is split in two. The static instructions are the command's
+// system message, identical on every call, and come first in the request.
+// The per-call part (current time, task data, user input) is the user
+// message, last. The server caches and reuses the shared prefix.
+static const char *SYSTEM_PROMPT[NR_AIC_CMD] = {
+    [AIC_CMD_CHAT] =
+    "You are a helpful assistant.",
+
+    [AIC_CMD_TASK_ADD] =
     "You are an expert task parsing and structuring assistant. Your job is to accurately determine and extract four key attributes from a single user-provided task description: title, description, due_date, and prio.\n\n"
-    "### Current Time Context\n"
-    "The current system time is: **%ld** (Unix Timestamp) / **%s** (UTC Readable Time).\n"
-    "Use this context to accurately resolve relative deadlines (e.g., 'next Monday', 'in 3 days').\n\n"
     "You **MUST** strictly adhere to the following data constraints and output format:\n\n"
     "### Data Constraints\n"
     "1. **title**: The task's brief title. Max length 128 characters.\n"
@@ -26,10 +40,82 @@ static const char *TASK_ADD_PROMPT_TEMPLATE =
     " * `2`: PRIORITY_MEDIUM\n"
     " * `3`: PRIORITY_LOW\n\n"
     "### Task Parsing Rules\n"
-    "* **due_date**: If no explicit date or time is mentioned in the task description, set `due_date` to the Unix timestamp for UTC midnight (00:00:00) **one week from the current time** as a reasonable default.\n"
+    "* **due_date**: Resolve relative deadlines (e.g., 'next Monday', 'in 3 days') against the current time given with the task. If no explicit date or time is mentioned in the task description, set `due_date` to the Unix timestamp for UTC midnight (00:00:00) **one week from the current time** as a reasonable default.\n"
     "* **prio**: Use the standard Chinese keywords mapping (紧急->0, 重要->1, 正常->2, 低优先级->3). Default to `2`.\n"
-    "* **Output Format**: The final output **MUST ONLY** be a JSON object, without any additional explanation, notes, code block markers, or extra text.\n\n"
-    "--- \n"
+    "* **Output Format**: The final output **MUST ONLY** be a JSON object, without any additional explanation, notes, code block markers, or extra text.",
+
+    [AIC_CMD_TASK_MULTI] =
+    "You are an expert task parsing and structuring assistant. The user's text may describe **several tasks** (e.g. '周五前交报告，下周一开会，顺便买咖啡'). Split it into separate tasks and extract four key attributes of each: title, description, due_date, and prio.\n\n"
+    "### Data Constraints\n"
+    "1. **title**: The task's brief title. Max length 128 characters.\n"
+    "2. **description**: Detailed task information. Max length 256 characters.\n"
+    "3. **due_date**: The required completion time (deadline). **MUST** be a standard Unix timestamp (seconds since 1970-01-01 UTC).\n"
+    "4. **prio**: The task's prio. **MUST** use one of the following integer enum values:\n"
+    " * `0`: PRIORITY_URGENT\n"
+    " * `1`: PRIORITY_IMPORTANT\n"
+    " * `2`: PRIORITY_MEDIUM\n"
+    " * `3`: PRIORITY_LOW\n\n"
+    "### Task Parsing Rules\n"
+    "* **Splitting**: One object per distinct action, in the order they appear. Shared context (a date or priority stated once for several tasks) applies to each of them. Do not invent tasks. At most " str(AIC_MULTI_MAX) " tasks.\n"
+    "* **due_date**: Resolve relative deadlines (e.g., 'next Monday', 'in 3 days') against the current time given with the text. If a task has no explicit date or time, set `due_date` to the Unix timestamp for UTC midnight (00:00:00) **one week from the current time** as a reasonable default.\n"
+    "* **prio**: Use the standard Chinese keywords mapping (紧急->0, 重要->1, 正常->2, 低优先级->3). Default to `2`.\n"
+    "* **Output Format**: The final output **MUST ONLY** be a JSON array of task objects (an array of one if there is a single task), without any additional explanation, notes, code block markers, or extra text.",
+
+    [AIC_CMD_TASK_UPDATE] =
+    "You are an expert task modification assistant. Your primary goal is to take the user's update instruction and the current task's state, apply the necessary changes, and return the **COMPLETE, MODIFIED TASK OBJECT**.\n"
+    "Resolve relative deadlines (e.g., '明天下午') against the current time given with the task.\n\n"
+    "### Data Constraints\n"
+    "1.  **Output Requirement**: You MUST return the **FULL JSON OBJECT** for the task after modification.\n"
+    "2.  **ID Integrity**: The `id` field in the original JSON **MUST NOT BE CHANGED** under any circumstance. Preserve the original `id` value.\n"
+    "3. **Created At Integrity**: The `created_at` field **MUST NOT BE CHANGED** under any circumstance. Preserve its original value.\n"
+    "4.  **Unmodified Fields**: Any field not mentioned in the update instruction MUST retain its original value from the Current Task State.\n"
+    "5.  **Status/Priority Encoding**: Status (`stat`) and Priority (`prio`) must use their corresponding integer enum values.\n\n"
+    // --- 新增优先级规则段落 ---
+    "### Priority Modification Rules\n"
+    "When modifying the `prio` field, strictly use the following mapping based on the instruction keywords:\n"
+    " * **0 (PRIORITY_URGENT)**: Use for keywords like: **紧急**, **立刻**, **必须**, **非常紧急**, **最高优先级**.\n"
+    " * **1 (PRIORITY_IMPORTANT)**: Use for keywords like: **重要**, **尽快**, **高优先级**.\n"
+    " * **2 (PRIORITY_MEDIUM)**: Use for keywords like: **正常**, **中等**, **默认**.\n"
+    " * **3 (PRIORITY_LOW)**: Use for keywords like: **不急**, **低优先级**, **有空再做**.",
+
+    [AIC_CMD_SUGGEST] =
+    "You are an expert task scheduling and prioritization assistant. Your goal is to analyze the provided list of tasks and recommend the single most important and urgent task that should be completed next. Focus on: **URGENCY** (due dates) and **PRIORITY** levels.\n\n"
+    "### Recommendation Requirement\n"
+    "1. **Analysis**: Briefly justify why this task is the best choice (e.g., 'Due date is today' or 'Highest priority and blocking other tasks').\n"
+    "2. **Output**: State the recommended task's ID, Title, and Description.\n"
+    "3. **Format**: The output MUST be in a human-readable, formatted text block, NOT a JSON object.\n\n"
+    "使用中文回答",
+
+    [AIC_CMD_REPORT] =
+    "You are an expert project management assistant specializing in writing reports from precomputed task statistics. Your goal is to generate a professional, structured report of the requested type (WEEKLY or MONTHLY).\n\n"
+    "The data were already aggregated over the reporting period (`period_start` to `period_end`). "
+    "`totals`, `by_status`, `by_priority` and `open_by_priority` are exact counts: use them as given and **do not recount** them from the task lists. "
+    "`recently_completed`, `pending_critical` and `overdue` only list the most relevant tasks (at most " str(REPORT_MAX_LISTED) " each).\n\n"
+    "### Report Requirements\n"
+    "1. **Summary of Completion**: Number of tasks completed and created in the period.\n"
+    "2. **Progress Analysis**: Key tasks completed and their impact.\n"
+    "3. **Pending Tasks**: Critical tasks (`URGENT`/`IMPORTANT` and `TODO`/`DOING`) pending completion, noting their due dates.\n"
+    "4. **Overdue Tasks**: Tasks past their due date and what should be done about them.\n"
+    "5. **Priority Breakdown**: Distribution of tasks by priority level (0 to 3).\n"
+    "6. **Format**: The output MUST be a well-formatted, easy-to-read text summary using markdown headings and bullet points, without any additional JSON or code block markers (like ```markdown).\n\n"
+    "使用中文回答",
+
+    [AIC_CMD_SUMMARY] =
+    "You maintain the running summary of a conversation between a user and an assistant. "
+    "You are given the summary so far (if any) followed by the turns to add. "
+    "Answer with the updated summary only: plain sentences, no headings or preamble. "
+    "Keep facts, names, numbers, decisions, the user's preferences and open questions; drop greetings and repetition. "
+    "Write it in the language of the conversation.",
+};
+
+const char *aic_system_prompt(aic_cmd_e cmd) {
+    return (cmd >= 0 && cmd < NR_AIC_CMD) ? SYSTEM_PROMPT[cmd] : SYSTEM_PROMPT[AIC_CMD_CHAT];
+}
+
+// Template placeholders: %ld (Current Unix Time), %s (Current Human-Readable Time), %s (Task Input)
+static const char *TASK_ADD_PROMPT_TEMPLATE =
+    "### Current Time Context\n"
+    "The current system time is: **%ld** (Unix Timestamp) / **%s** (UTC Readable Time).\n\n"
     "### Task to Parse\n"
     "%s" // Placeholder for task_input
     "\n\n### Expected Output (JSON)\n";
@@ -39,7 +125,7 @@ char* aic_task_add_prompt(const char *task_input) {
         return NULL;
     }
     
-    time_t current_time = time(NULL); 
+    time_t current_time = prompt_time(PROMPT_TIME_GRANULARITY); 
     
     char time_buffer[64];
     psr_readable_time(current_time, time_buffer, sizeof(time_buffer)); 
@@ -70,26 +156,48 @@ char* aic_task_add_prompt(const char *task_input) {
     return full_prompt;
 }
 
+// Template placeholders: %ld (Current Unix Time), %s (Current Human-Readable Time), %s (Task Input)
+static const char *TASK_MULTI_PROMPT_TEMPLATE =
+    "### Current Time Context\n"
+    "The current system time is: **%ld** (Unix Timestamp) / **%s** (UTC Readable Time).\n\n"
+    "### Tasks to Parse\n"
+    "%s" // Placeholder for task_input
+    "\n\n### Expected Output (JSON Array)\n";
+
+char* aic_task_multi_prompt(const char *task_input) {
+    if (!task_input) {
+        return NULL;
+    }
+
+    time_t current_time = prompt_time(PROMPT_TIME_GRANULARITY);
+
+    char time_buffer[64];
+    psr_readable_time(current_time, time_buffer, sizeof(time_buffer));
+
+    size_t required_len = strlen(TASK_MULTI_PROMPT_TEMPLATE) + strlen(task_input) +
+                          strlen(time_buffer) + 20 + 1;
+    char *full_prompt = (char*)malloc(required_len);
+    if (full_prompt == NULL) {
+        return NULL; // Memory allocation failure
+    }
+
+    int written = snprintf(full_prompt, required_len,
+                           TASK_MULTI_PROMPT_TEMPLATE,
+                           (long)current_time,      // %ld (Unix Timestamp)
+                           time_buffer,             // %s (Readable Time)
+                           task_input);             // %s (Task Input)
+
+    if (written < 0 || (size_t)written >= required_len) {
+        free(full_prompt);
+        return NULL;
+    }
+    return full_prompt;
+}
+
 static const char *TASK_UPDATE_PROMPT_TEMPLATE =
-    "You are an expert task modification assistant. Your primary goal is to take the user's update instruction and the current task's state, apply the necessary changes, and return the **COMPLETE, MODIFIED TASK OBJECT**.\n\n"
     "### Current Time Context\n"
     "The current system time is: **%ld** (Unix Timestamp) / **%s** (UTC Readable Time).\n"
-    "The task was originally created at: **%ld** (Unix Timestamp) / **%s** (UTC Readable Time).\n" 
-    "Use this context to accurately resolve relative deadlines (e.g., '明天下午').\n\n"
-    "### Data Constraints\n"
-    "1.  **Output Requirement**: You MUST return the **FULL JSON OBJECT** for the task after modification.\n"
-    "2.  **ID Integrity**: The `id` field in the original JSON **MUST NOT BE CHANGED** under any circumstance. Preserve the original `id` value.\n"
-    "3. **Created At Integrity**: The `created_at` field **MUST NOT BE CHANGED** under any circumstance. Preserve its original value.\n"
-    "4.  **Unmodified Fields**: Any field not mentioned in the update instruction MUST retain its original value from the Current Task State.\n"
-    "5.  **Status/Priority Encoding**: Status (`stat`) and Priority (`prio`) must use their corresponding integer enum values.\n\n"
-    // --- 新增优先级规则段落 ---
-    "### Priority Modification Rules\n"
-    "When modifying the `prio` field, strictly use the following mapping based on the instruction keywords:\n"
-    " * **0 (PRIORITY_URGENT)**: Use for keywords like: **紧急**, **立刻**, **必须**, **非常紧急**, **最高优先级**.\n"
-    " * **1 (PRIORITY_IMPORTANT)**: Use for keywords like: **重要**, **尽快**, **高优先级**.\n"
-    " * **2 (PRIORITY_MEDIUM)**: Use for keywords like: **正常**, **中等**, **默认**.\n"
-    " * **3 (PRIORITY_LOW)**: Use for keywords like: **不急**, **低优先级**, **有空再做**.\n\n"
-    // --- 恢复原始模板结构 ---
+    "The task was originally created at: **%ld** (Unix Timestamp) / **%s** (UTC Readable Time).\n\n" 
     "### Current Task State (JSON)\n"
     "%s\n\n" // Placeholder for current_task_json
     "### Update Instruction\n"
@@ -101,7 +209,7 @@ char* aic_task_update_prompt(const char *current_task_json, const char *instruct
         return NULL;
     }
 
-    time_t current_time = time(NULL); 
+    time_t current_time = prompt_time(PROMPT_TIME_GRANULARITY); 
     
     char current_time_buffer[64];
     psr_readable_time(current_time, current_time_buffer, sizeof(current_time_buffer)); 
@@ -139,86 +247,100 @@ char* aic_task_update_prompt(const char *current_task_json, const char *instruct
     return full_prompt;
 }
 
-static const char *TASK_SUGGEST_PROMPT_TEMPLATE =
-    "You are an expert task scheduling and prioritization assistant. Your goal is to analyze the provided list of tasks and recommend the single most important and urgent task that should be completed next. Focus on: **URGENCY** (due dates) and **PRIORITY** levels.\n\n"
-    "### Current Task List (JSON Array)\n"
-    "%s\n\n" // Placeholder for task_list_json
-    "### Recommendation Requirement\n"
-    "1. **Analysis**: Briefly justify why this task is the best choice (e.g., 'Due date is today' or 'Highest priority and blocking other tasks').\n"
-    "2. **Output**: State the recommended task's ID, Title, and Description.\n"
-    "3. **Format**: The output MUST be in a human-readable, formatted text block, NOT a JSON object.\n\n"
-    "### Expected Output\n"
-    "使用中文回答\n";
+// Encoding of the task data each template embeds. The update template keeps
+// JSON: the model edits that object and answers with it.
+static aic_format_e template_format[NR_AIC_CMD] = {
+    [AIC_CMD_SUGGEST] = AIC_FORMAT_TABLE,
+    [AIC_CMD_REPORT]  = AIC_FORMAT_TABLE,
+};
 
-char* aic_task_suggest_prompt(const char *task_list_json) {
-    if (!task_list_json) return NULL;
-    
-    // Allocate memory and construct the prompt similar to previous implementations
-    size_t template_len = strlen(TASK_SUGGEST_PROMPT_TEMPLATE);
-    size_t json_len = strlen(task_list_json);
-    size_t required_len = template_len + json_len + 128 + 1; // 128 byte buffer
-    
-    char *full_prompt = (char*)malloc(required_len);
-    if (full_prompt == NULL) return NULL;
+aic_format_e aic_template_format(aic_cmd_e cmd) {
+    return (cmd >= 0 && cmd < NR_AIC_CMD) ? template_format[cmd] : AIC_FORMAT_JSON;
+}
 
-    int written = snprintf(full_prompt, required_len, 
-                           TASK_SUGGEST_PROMPT_TEMPLATE, 
-                           task_list_json);
+void aic_set_template_format(aic_cmd_e cmd, aic_format_e format) {
+    if (cmd >= 0 && cmd < NR_AIC_CMD) template_format[cmd] = format;
+}
 
-    if (written < 0 || (size_t)written >= required_len) {
-        free(full_prompt);
-        return NULL;
-    }
+#define TABLE_LEGEND \
+    "Fields are separated by '|' and named in the header row; empty fields are blank and trailing ones are omitted. " \
+    "`due`, `created` and `done` are relative to now: `+3d` is in 3 days, `-5h` was 5 hours ago.\n"
 
-    return full_prompt;
+// The data are spliced in as their own rope piece, so a (possibly large) task
+// dump is never copied into a prompt buffer. The heading before them only
+// depends on the encoding, so it still belongs to the cached prefix.
+static const char *TASK_LIST_HEADING[] = {
+    [AIC_FORMAT_JSON]  = "### Current Task List (JSON Array)\n",
+    [AIC_FORMAT_TABLE] = "### Current Task List (Table, one task per line)\n" TABLE_LEGEND,
+};
+
+static const char *TASK_SUGGEST_PROMPT_TAIL =
+    "\n\n"
+    "### Expected Output\n";
+
+aic_prompt_t* aic_task_suggest_prompt(char *task_list) {
+    if (!task_list) return NULL;
+
+    aic_prompt_t *prompt = aic_prompt_new();
+    aic_prompt_add(prompt, TASK_LIST_HEADING[template_format[AIC_CMD_SUGGEST]]);
+    aic_prompt_add_owned(prompt, task_list);
+    aic_prompt_add(prompt, TASK_SUGGEST_PROMPT_TAIL);
+    return prompt;
 }
 
 
-static const char *REPORT_PROMPT_TEMPLATE =
-    "You are an expert project management assistant specializing in generating comprehensive reports based on raw task data. Your goal is to generate a professional, structured **%s REPORT**.\n\n" // %s: WEEKLY or MONTHLY
-    "### Current Time Context\n"
-    "The current system date is: %ld (Unix Timestamp). Use this to identify tasks relevant to the reporting period.\n\n"
-    "### Task Data (JSON Array)\n"
-    "%s\n\n" // %s: task_list_json
-    "### Report Requirements\n"
-    "Based on the provided task data, generate a summary covering the following points. Focus the analysis on tasks that were **active, created, or completed** within the relevant reporting period (last 7 days for WEEKLY, last 30 days for MONTHLY):\n"
-    "1. **Summary of Completion**: Total number of tasks completed (`DONE`).\n"
-    "2. **Progress Analysis**: List of key tasks completed and their impact.\n"
-    "3. **Pending Tasks**: List of critical tasks (`URGENT`/`IMPORTANT` and `TODO`/`DOING`) pending completion, noting their original due dates.\n"
-    "4. **Priority Breakdown**: Distribution of tasks by priority level (0 to 3).\n"
-    "5. **Format**: The output MUST be a well-formatted, easy-to-read text summary using markdown headings and bullet points, without any additional JSON or code block markers (like ```markdown).\n\n"
-    "### Expected Output (Structured Text Report)\n"
-    "使用中文回答";
-
-char* aic_report_prompt(const char *task_list_json, const char *report_type) {
-    if (!task_list_json || !report_type) {
+// The report data are aggregates computed locally (db_build_report), so the
+// prompt size no longer grows with the number of tasks.
+static const char *REPORT_DATA_HEADING[] = {
+    [AIC_FORMAT_JSON]  = "### Report Data (JSON Object)\n",
+    [AIC_FORMAT_TABLE] = "### Report Data\nCounts are `key=value` pairs; task lists are tables, one task per line. " TABLE_LEGEND,
+};
+
+static const char *REPORT_PROMPT_TAIL =
+    "\n\n"
+    "### Report Request\n"
+    "Write the **%s REPORT**.\n" // %s: WEEKLY or MONTHLY
+    "The current system date is: %ld (Unix Timestamp).\n\n"
+    "### Expected Output (Structured Text Report)\n";
+
+aic_prompt_t* aic_report_prompt(char *report_data, const char *report_type) {
+    if (!report_data || !report_type) {
+        free(report_data);
         return NULL;
     }
 
-    time_t current_time = time(NULL); 
-    
-    size_t template_len = strlen(REPORT_PROMPT_TEMPLATE);
-    size_t json_len = strlen(task_list_json);
-    size_t type_len = strlen(report_type);
-    
-    // Generous estimation: template + JSON + report type + timestamp string + buffer
-    size_t required_len = template_len + json_len + type_len + 20 + 256 + 1; 
-    
-    char *full_prompt = (char*)malloc(required_len);
-    if (full_prompt == NULL) {
-        return NULL; // Memory allocation failure
-    }
+    time_t current_time = prompt_time(REPORT_TIME_GRANULARITY);
 
-    int written = snprintf(full_prompt, required_len, 
-                           REPORT_PROMPT_TEMPLATE, 
-                           report_type,                  // %s (Report Type)
-                           (long)current_time,           // %ld (Unix Timestamp)
-                           task_list_json);              // %s (Task List JSON)
+    aic_prompt_t *prompt = aic_prompt_new();
+    aic_prompt_add(prompt, REPORT_DATA_HEADING[template_format[AIC_CMD_REPORT]]);
+    aic_prompt_add_owned(prompt, report_data);
+    aic_prompt_addf(prompt, REPORT_PROMPT_TAIL,
+                    report_type,                  // %s (Report Type)
+                    (long)current_time);          // %ld (Unix Timestamp)
+    return prompt;
+}
 
-    if (written < 0 || (size_t)written >= required_len) {
-        free(full_prompt);
-        return NULL;
-    }
+size_t aic_data_budget(aic_cmd_e cmd) {
+    size_t budget = aic_get_token_budget(cmd);
+    size_t fixed = TOK_REQUEST_OVERHEAD;
 
-    return full_prompt;
-}
\ No newline at end of file
+    if (budget == 0) return 0;
+
+    // Format placeholders count about as much as what replaces them
+    fixed += aic_estimate_tokens(aic_system_prompt(cmd), strlen(aic_system_prompt(cmd)));
+    switch (cmd) {
+        case AIC_CMD_SUGGEST:
+            fixed += aic_estimate_tokens(TASK_LIST_HEADING[template_format[cmd]],
+                                         strlen(TASK_LIST_HEADING[template_format[cmd]]));
+            fixed += aic_estimate_tokens(TASK_SUGGEST_PROMPT_TAIL, strlen(TASK_SUGGEST_PROMPT_TAIL));
+            break;
+        case AIC_CMD_REPORT:
+            fixed += aic_estimate_tokens(REPORT_DATA_HEADING[template_format[cmd]],
+                                         strlen(REPORT_DATA_HEADING[template_format[cmd]]));
+            fixed += aic_estimate_tokens(REPORT_PROMPT_TAIL, strlen(REPORT_PROMPT_TAIL));
+            break;
+        default:
+            break;
+    }
+    return budget > fixed ? budget - fixed : 1;
+}
@@ -0,0 +1,308 @@
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "response_cache.h"
+
+// Content-addressed response cache.
+// On disk: an append-only log of records, each a header followed by the response bytes.
+// A later record with the same key supersedes an earlier one, and an expired one
+// (also written for evictions) drops it; the log is rewritten with only the live
+// records once it grows past twice the size bound.
+
+#define RC_MAGIC 0x31434341u // "ACC1"
+
+typedef struct {
+  uint32_t magic;
+  uint32_t len;         // payload bytes following the header
+  uint64_t key[2];
+  int64_t  expires_at;  // 0 means never
+} rc_record_t;
+
+typedef struct {
+  uint64_t key[2];
+  long     offset;      // payload offset in the file
+  uint32_t len;
+  int64_t  expires_at;
+  uint64_t last_used;   // LRU clock
+} rc_entry_t;
+
+static FILE *rc_fp = NULL;
+static char *rc_path = NULL;
+static rc_entry_t *entries = NULL;
+static int nr_entries = 0;
+static int max_entries = 0;
+static size_t live_bytes = 0;
+static uint64_t lru_clock = 0;
+static aic_cache_stats_t stats;
+static pthread_mutex_t rc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// --- Internal Functions ---
+
+static bool is_expired(const rc_entry_t *e, int64_t now) {
+  return e->expires_at != 0 && e->expires_at <= now;
+}
+
+static int find_entry(const uint64_t key[2]) {
+  for (int i = 0; i < nr_entries; i ++) {
+    if (entries[i].key[0] == key[0] && entries[i].key[1] == key[1]) return i;
+  }
+  return -1;
+}
+
+static void remove_entry(int i) {
+  live_bytes -= entries[i].len;
+  entries[i] = entries[-- nr_entries];
+}
+
+static int add_entry(const uint64_t key[2], long offset, uint32_t len, int64_t expires_at) {
+  int i = find_entry(key);
+  if (i >= 0) remove_entry(i);
+
+  if (nr_entries == max_entries) {
+    int new_max = max_entries ? max_entries * 2 : 64;
+    rc_entry_t *p = realloc(entries, new_max * sizeof(rc_entry_t));
+    if (p == NULL) return -1;
+    entries = p;
+    max_entries = new_max;
+  }
+
+  rc_entry_t *e = &entries[nr_entries ++];
+  e->key[0] = key[0];
+  e->key[1] = key[1];
+  e->offset = offset;
+  e->len = len;
+  e->expires_at = expires_at;
+  e->last_used = ++ lru_clock;
+  live_bytes += len;
+  return 0;
+}
+
+// Drops least recently used entries until `incoming` more bytes fit. Each
+// eviction is logged as an expired record so it still holds after a restart.
+static void evict_for(size_t incoming) {
+  bool evicted = false;
+
+  while (nr_entries > 0 && live_bytes + incoming > RC_MAX_BYTES) {
+    int victim = 0;
+    for (int i = 1; i < nr_entries; i ++) {
+      if (entries[i].last_used < entries[victim].last_used) victim = i;
+    }
+    rc_record_t rec = { RC_MAGIC, 0, { entries[victim].key[0], entries[victim].key[1] }, 1 };
+    if (fseek(rc_fp, 0, SEEK_END) != 0 || fwrite(&rec, sizeof(rec), 1, rc_fp) != 1) {
+      Log("WARN: Failed to log an eviction in the AI response cache.");
+    }
+    remove_entry(victim);
+    stats.evictions ++;
+    evicted = true;
+  }
+  if (evicted) fflush(rc_fp);
+}
+
+// Rewrites the log with only the live entries
+static void compact(void) {
+  size_t tmp_len = strlen(rc_path) + 5;
+  char *tmp_path = malloc(tmp_len);
+  char *payload = NULL;
+  FILE *out = NULL;
+
+  if (tmp_path == NULL) return;
+  snprintf(tmp_path, tmp_len, "%s.tmp", rc_path);
+  out = fopen(tmp_path, "wb");
+  if (out == NULL) goto fail;
+
+  for (int i = 0; i < nr_entries; i ++) {
+    rc_entry_t *e = &entries[i];
+    rc_record_t rec = { RC_MAGIC, e->len, { e->key[0], e->key[1] }, e->expires_at };
+
+    payload = realloc(payload, e->len ? e->len : 1);
+    if (payload == NULL ||
+        fseek(rc_fp, e->offset, SEEK_SET) != 0 ||
+        fread(payload, 1, e->len, rc_fp) != e->len ||
+        fwrite(&rec, sizeof(rec), 1, out) != 1) goto fail;
+    e->offset = ftell(out);
+    if (fwrite(payload, 1, e->len, out) != e->len) goto fail;
+  }
+
+  if (fclose(out) != 0) { out = NULL; goto fail; }
+  out = NULL;
+  if (rename(tmp_path, rc_path) != 0) goto fail;
+
+  fclose(rc_fp);
+  rc_fp = fopen(rc_path, "a+b");
+  free(payload);
+  free(tmp_path);
+  return;
+
+fail:
+  // Offsets may be half-rewritten: the safest recovery is an empty cache
+  Log("WARN: AI response cache compaction failed, cache cleared.");
+  if (out) fclose(out);
+  remove(tmp_path);
+  nr_entries = 0;
+  live_bytes = 0;
+  if (rc_fp && ftruncate(fileno(rc_fp), 0) != 0) {
+    fclose(rc_fp);
+    rc_fp = NULL;
+  }
+  free(payload);
+  free(tmp_path);
+}
+
+// --- Public Functions ---
+
+int rc_init(const char *path) {
+  rc_record_t rec;
+  long offset = 0, size;
+  int64_t now = time(NULL);
+
+  rc_fp = fopen(path, "a+b");
+  if (rc_fp == NULL) {
+    Log("WARN: Can't open AI response cache '%s', caching disabled.", path);
+    return -1;
+  }
+  rc_path = strdup(path);
+
+  // Replay the log; a torn record at the tail is cut off. fseek() succeeds past
+  // the end of the file, so a payload is checked against the size instead.
+  if (fseek(rc_fp, 0, SEEK_END) != 0 || (size = ftell(rc_fp)) < 0) size = 0;
+  fseek(rc_fp, 0, SEEK_SET);
+  while (fread(&rec, sizeof(rec), 1, rc_fp) == 1 && rec.magic == RC_MAGIC) {
+    long payload = offset + (long)sizeof(rec);
+    if (payload + (long)rec.len > size || fseek(rc_fp, rec.len, SEEK_CUR) != 0) break;
+    if (rec.expires_at == 0 || rec.expires_at > now) {
+      add_entry(rec.key, payload, rec.len, rec.expires_at);
+    } else if (find_entry(rec.key) >= 0) {
+      remove_entry(find_entry(rec.key));
+    }
+    offset = payload + rec.len;
+  }
+  if (offset < size && ftruncate(fileno(rc_fp), offset) != 0) {
+    Log("WARN: Can't truncate damaged tail of AI response cache.");
+  }
+
+  evict_for(0);
+  return 0;
+}
+
+// Two independent 64-bit hashes: FNV-1a and a multiply-xorshift mix
+void rc_hash_init(rc_hash_t *h) {
+  h->h1 = 14695981039346656037ull;
+  h->h2 = 0x9e3779b97f4a7c15ull;
+}
+
+void rc_hash_update(rc_hash_t *h, const char *data, size_t len) {
+  uint64_t h1 = h->h1, h2 = h->h2;
+  for (const unsigned char *c = (const unsigned char *)data; len > 0; c ++, len --) {
+    h1 = (h1 ^ *c) * 1099511628211ull;
+    h2 = (h2 ^ *c) * 0xff51afd7ed558ccdull;
+    h2 ^= h2 >> 29;
+  }
+  h->h1 = h1;
+  h->h2 = h2;
+}
+
+// Separator so ("ab", "c") and ("a", "bc") differ
+void rc_hash_next_part(rc_hash_t *h) {
+  h->h1 = (h->h1 ^ 0xff) * 1099511628211ull;
+  h->h2 = (h->h2 ^ 0xff) * 0xff51afd7ed558ccdull;
+}
+
+void rc_hash_final(rc_hash_t *h, uint64_t key[2]) {
+  key[0] = h->h1;
+  key[1] = h->h2 ^ (h->h2 >> 33);
+}
+
+void rc_make_key(const char *endpoint, const char *body, uint64_t key[2]) {
+  rc_hash_t h;
+  rc_hash_init(&h);
+  rc_hash_update(&h, endpoint, strlen(endpoint));
+  rc_hash_next_part(&h);
+  rc_hash_update(&h, body, strlen(body));
+  rc_hash_next_part(&h);
+  rc_hash_final(&h, key);
+}
+
+char *rc_get(const uint64_t key[2]) {
+  char *value = NULL;
+
+  pthread_mutex_lock(&rc_lock);
+  if (rc_fp == NULL) goto out;
+
+  int i = find_entry(key);
+  if (i >= 0 && is_expired(&entries[i], time(NULL))) {
+    remove_entry(i);
+    i = -1;
+  }
+  if (i < 0) {
+    stats.misses ++;
+    goto out;
+  }
+
+  rc_entry_t *e = &entries[i];
+  value = malloc(e->len + 1);
+  if (value == NULL ||
+      fseek(rc_fp, e->offset, SEEK_SET) != 0 ||
+      fread(value, 1, e->len, rc_fp) != e->len) {
+    SAFE_FREE(value);
+    remove_entry(i);
+    stats.misses ++;
+    goto out;
+  }
+  value[e->len] = '\0';
+  e->last_used = ++ lru_clock;
+  stats.hits ++;
+
+out:
+  pthread_mutex_unlock(&rc_lock);
+  return value;
+}
+
+void rc_put(const uint64_t key[2], const char *value, long ttl) {
+  size_t len = strlen(value);
+  rc_record_t rec = { RC_MAGIC, (uint32_t)len, { key[0], key[1] },
+                      ttl == AIC_TTL_FOREVER ? 0 : (int64_t)time(NULL) + ttl };
+
+  if (ttl == 0 || len > RC_MAX_BYTES) return;
+
+  pthread_mutex_lock(&rc_lock);
+  if (rc_fp == NULL) goto out;
+
+  evict_for(len);
+
+  // "a+" mode: writes always land at the end of the file
+  fseek(rc_fp, 0, SEEK_END);
+  long offset = ftell(rc_fp) + (long)sizeof(rec);
+  if (fwrite(&rec, sizeof(rec), 1, rc_fp) != 1 ||
+      fwrite(value, 1, len, rc_fp) != len ||
+      fflush(rc_fp) != 0) {
+    Log("WARN: Failed to append to AI response cache.");
+    goto out;
+  }
+  add_entry(key, offset, (uint32_t)len, rec.expires_at);
+  stats.stores ++;
+
+  if (offset > 2 * RC_MAX_BYTES) compact();
+
+out:
+  pthread_mutex_unlock(&rc_lock);
+}
+
+void rc_get_stats(aic_cache_stats_t *out) {
+  pthread_mutex_lock(&rc_lock);
+  *out = stats;
+  out->entries = nr_entries;
+  out->bytes = live_bytes;
+  pthread_mutex_unlock(&rc_lock);
+}
+
+void rc_shutdown(void) {
+  pthread_mutex_lock(&rc_lock);
+  if (rc_fp) fclose(rc_fp);
+  rc_fp = NULL;
+  SAFE_FREE(rc_path);
+  SAFE_FREE(entries);
+  nr_entries = max_entries = 0;
+  live_bytes = 0;
+  pthread_mutex_unlock(&rc_lock);
+}
@@ -0,0 +1,49 @@
+#ifndef __RESPONSE_CACHE_H__
+#define __RESPONSE_CACHE_H__
+
+#include <stdint.h>
+#include "ai_client.h"
+
+// Upper bound for the payload bytes kept in the cache
+#define RC_MAX_BYTES (8 * 1024 * 1024)
+
+/**
+ * @brief Opens (or creates) the append-only cache file and rebuilds the in-memory index.
+ * @return 0 on success, -1 if the file can not be opened (the cache stays disabled).
+ */
+int rc_init(const char *path);
+
+/**
+ * @brief Computes the 128-bit content address of a request.
+ * * The endpoint is part of the key so answers from a stand-in server are
+ *   never replayed against the real one (the body already names the model).
+ */
+void rc_make_key(const char *endpoint, const char *body, uint64_t key[2]);
+
+// Incremental form of rc_make_key() for bodies that are produced in pieces:
+// init, update with the endpoint, next_part, update with the body pieces, final
+typedef struct {
+  uint64_t h1, h2;
+} rc_hash_t;
+
+void rc_hash_init(rc_hash_t *h);
+void rc_hash_update(rc_hash_t *h, const char *data, size_t len);
+void rc_hash_next_part(rc_hash_t *h);
+void rc_hash_final(rc_hash_t *h, uint64_t key[2]);
+
+/**
+ * @brief Looks up a cached response.
+ * @return A malloc'ed copy of the response, or NULL on a miss. The caller frees it.
+ */
+char *rc_get(const uint64_t key[2]);
+
+/**
+ * @brief Appends a response to the cache.
+ * @param ttl Lifetime in seconds, AIC_TTL_FOREVER for no expiry.
+ */
+void rc_put(const uint64_t key[2], const char *value, long ttl);
+
+void rc_get_stats(aic_cache_stats_t *stats);
+void rc_shutdown(void);
+
+#endif
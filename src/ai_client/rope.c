@@ -0,0 +1,221 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "common.h"
+#include "rope.h"
+
+typedef struct {
+  const char *ptr;
+  size_t len;
+  bool owned;
+  bool raw;             // request JSON between messages, sent unescaped
+} rope_segment_t;
+
+struct aic_prompt {
+  rope_segment_t *segs;
+  size_t nr_segs;
+  size_t cap;
+  size_t len;
+};
+
+aic_prompt_t *aic_prompt_new(void) {
+  aic_prompt_t *p = calloc(1, sizeof(aic_prompt_t));
+  if (!p) panic("Memory allocation failed for prompt.");
+  return p;
+}
+
+static void prompt_push(aic_prompt_t *p, const char *str, size_t len, bool owned, bool raw) {
+  if (p->nr_segs == p->cap) {
+    p->cap = p->cap ? p->cap * 2 : 8;
+    p->segs = realloc(p->segs, p->cap * sizeof(rope_segment_t));
+    if (!p->segs) panic("Memory allocation failed for prompt.");
+  }
+  p->segs[p->nr_segs ++] = (rope_segment_t){ str, len, owned, raw };
+  p->len += len;
+}
+
+void aic_prompt_add(aic_prompt_t *p, const char *str) {
+  if (str && *str) prompt_push(p, str, strlen(str), false, false);
+}
+
+void aic_prompt_add_owned(aic_prompt_t *p, char *str) {
+  if (str) prompt_push(p, str, strlen(str), true, false);
+}
+
+void aic_prompt_addf(aic_prompt_t *p, const char *fmt, ...) {
+  va_list ap;
+
+  va_start(ap, fmt);
+  int len = vsnprintf(NULL, 0, fmt, ap);
+  va_end(ap);
+  char *str = len >= 0 ? malloc(len + 1) : NULL;
+  if (!str) panic("Memory allocation failed for prompt.");
+
+  va_start(ap, fmt);
+  vsnprintf(str, len + 1, fmt, ap);
+  va_end(ap);
+  prompt_push(p, str, len, true, false);
+}
+
+void rope_add_raw(aic_prompt_t *p, const char *json) {
+  prompt_push(p, json, strlen(json), false, true);
+}
+
+aic_prompt_t *aic_prompt_wrap(char *str) {
+  if (!str) return NULL;
+  aic_prompt_t *p = aic_prompt_new();
+  aic_prompt_add_owned(p, str);
+  return p;
+}
+
+size_t aic_prompt_len(const aic_prompt_t *p) {
+  return p->len;
+}
+
+char *aic_prompt_flatten(const aic_prompt_t *p) {
+  char *str = malloc(p->len + 1);
+  if (!str) return NULL;
+  size_t off = 0;
+  for (size_t i = 0; i < p->nr_segs; i ++) {
+    memcpy(str + off, p->segs[i].ptr, p->segs[i].len);
+    off += p->segs[i].len;
+  }
+  str[off] = '\0';
+  return str;
+}
+
+size_t aic_prompt_tokens(const aic_prompt_t *p) {
+  size_t tokens = 0;
+  for (size_t i = 0; i < p->nr_segs; i ++) {
+    tokens += aic_estimate_tokens(p->segs[i].ptr, p->segs[i].len);
+  }
+  return tokens;
+}
+
+void aic_prompt_free(aic_prompt_t *p) {
+  if (!p) return;
+  for (size_t i = 0; i < p->nr_segs; i ++) {
+    if (p->segs[i].owned) free((char *)p->segs[i].ptr);
+  }
+  free(p->segs);
+  free(p);
+}
+
+// --- Request body ---
+
+// Escape sequence of c (same choices as cJSON), or 0 if c is copied as is
+static size_t escape_char(unsigned char c, char out[8]) {
+  switch (c) {
+    case '"':  memcpy(out, "\\\"", 2); return 2;
+    case '\\': memcpy(out, "\\\\", 2); return 2;
+    case '\b': memcpy(out, "\\b", 2); return 2;
+    case '\f': memcpy(out, "\\f", 2); return 2;
+    case '\n': memcpy(out, "\\n", 2); return 2;
+    case '\r': memcpy(out, "\\r", 2); return 2;
+    case '\t': memcpy(out, "\\t", 2); return 2;
+    default:
+      if (c < 32) {
+        snprintf(out, 8, "\\u%04x", c);
+        return 6;
+      }
+      return 0;
+  }
+}
+
+char *rope_escape(const char *s) {
+  size_t len = 0;
+  char esc[8];
+  for (const unsigned char *c = (const unsigned char *)s; *c; c ++) {
+    size_t n = escape_char(*c, esc);
+    len += n ? n : 1;
+  }
+
+  char *out = malloc(len + 1);
+  if (!out) return NULL;
+  char *o = out;
+  for (const unsigned char *c = (const unsigned char *)s; *c; c ++) {
+    size_t n = escape_char(*c, esc);
+    if (n) {
+      memcpy(o, esc, n);
+      o += n;
+    } else {
+      *o ++ = *c;
+    }
+  }
+  *o = '\0';
+  return out;
+}
+
+void rope_body_init(rope_body_t *b, const aic_prompt_t *prompt, const char *head, const char *tail) {
+  memset(b, 0, sizeof(*b));
+  b->prompt = prompt;
+  b->head = head;
+  b->tail = tail;
+}
+
+void rope_body_rewind(rope_body_t *b) {
+  rope_body_init(b, b->prompt, b->head, b->tail);
+}
+
+size_t rope_body_read(rope_body_t *b, char *buf, size_t size) {
+  size_t n = 0;
+  size_t nr_segs = b->prompt->nr_segs;
+
+  while (n < size) {
+    // Rest of an escape sequence split at the previous buffer boundary
+    if (b->pending_off < b->nr_pending) {
+      buf[n ++] = b->pending[b->pending_off ++];
+      continue;
+    }
+
+    const char *ptr;
+    size_t len;
+    bool escape = false;
+    if (b->piece == 0) {
+      ptr = b->head;
+      len = strlen(b->head);
+    } else if (b->piece <= nr_segs) {
+      ptr = b->prompt->segs[b->piece - 1].ptr;
+      len = b->prompt->segs[b->piece - 1].len;
+      escape = !b->prompt->segs[b->piece - 1].raw;
+    } else if (b->piece == nr_segs + 1) {
+      ptr = b->tail;
+      len = strlen(b->tail);
+    } else {
+      break;  // end of body
+    }
+
+    if (b->off >= len) {
+      b->piece ++;
+      b->off = 0;
+      continue;
+    }
+
+    if (!escape) {
+      size_t k = len - b->off < size - n ? len - b->off : size - n;
+      memcpy(buf + n, ptr + b->off, k);
+      b->off += k;
+      n += k;
+      continue;
+    }
+
+    // Copy the run of characters that need no escaping in one go
+    size_t run = 0;
+    char esc[8];
+    while (b->off + run < len && n + run < size &&
+           escape_char((unsigned char)ptr[b->off + run], esc) == 0) {
+      run ++;
+    }
+    if (run > 0) {
+      memcpy(buf + n, ptr + b->off, run);
+      b->off += run;
+      n += run;
+      continue;
+    }
+
+    b->nr_pending = escape_char((unsigned char)ptr[b->off ++], b->pending);
+    b->pending_off = 0;
+  }
+  return n;
+}
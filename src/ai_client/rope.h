@@ -0,0 +1,44 @@
+#ifndef __ROPE_H__
+#define __ROPE_H__
+
+#include <stddef.h>
+#include "ai_client.h"
+
+// Streams the JSON request body of a prompt without materializing it:
+// head (raw JSON) + every prompt segment JSON-escaped + tail (raw JSON).
+// Raw segments (rope_add_raw) are copied as is; they close the user message
+// and open further ones, so a prompt can carry a whole conversation.
+// The escaping matches cJSON's; flat bodies are built with rope_escape() too.
+typedef struct {
+  const aic_prompt_t *prompt;
+  const char *head;
+  const char *tail;
+  size_t piece;         // 0: head, 1..nr_segments: segments, then tail
+  size_t off;           // offset in the current piece
+  char pending[8];      // escape sequence that did not fit in the last buffer
+  size_t nr_pending;
+  size_t pending_off;
+} rope_body_t;
+
+// Raw pieces between the messages of a conversation
+#define ROPE_TO_ASSISTANT "\"},{\"role\":\"assistant\",\"content\":\""
+#define ROPE_TO_USER      "\"},{\"role\":\"user\",\"content\":\""
+
+// Borrowed piece of request JSON, e.g. ROPE_TO_ASSISTANT
+void rope_add_raw(aic_prompt_t *p, const char *json);
+
+void rope_body_init(rope_body_t *b, const aic_prompt_t *prompt, const char *head, const char *tail);
+void rope_body_rewind(rope_body_t *b);
+
+/**
+ * @brief Copies the next bytes of the body into buf.
+ * @return Bytes written, 0 at the end of the body.
+ */
+size_t rope_body_read(rope_body_t *b, char *buf, size_t size);
+
+/**
+ * @brief Returns s JSON-escaped (without quotes); the caller frees it.
+ */
+char *rope_escape(const char *s);
+
+#endif
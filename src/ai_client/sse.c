@@ -0,0 +1,90 @@
+#include "common.h"
+#include "sse.h"
+#include "cJSON.h"
+#include "tokens.h"
+
+static int mem_append(MemoryStruct_t *mem, const char *data, size_t len) {
+  char *ptr = realloc(mem->memory, mem->size + len + 1);
+  if (ptr == NULL) return -1;
+
+  mem->memory = ptr;
+  memcpy(&(mem->memory[mem->size]), data, len);
+  mem->size += len;
+  mem->memory[mem->size] = 0;
+  return 0;
+}
+
+// Handles one complete "data:" payload
+static int handle_event(sse_parser_t *p, const char *data) {
+  p->nr_events ++;
+  if (strcmp(data, "[DONE]") == 0) {
+    p->done = true;
+    return 0;
+  }
+
+  cJSON *chunk = cJSON_Parse(data);
+  if (chunk == NULL) {
+    Log("WARN: Malformed stream event ignored: %s", data);
+    return 0;
+  }
+
+  tok_read_usage(chunk, &p->usage);
+
+  cJSON *choice = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(chunk, "choices"), 0);
+  cJSON *delta = cJSON_GetObjectItemCaseSensitive(choice, "delta");
+  cJSON *content = cJSON_GetObjectItemCaseSensitive(delta, "content");
+  int ret = 0;
+
+  if (cJSON_IsString(content) && content->valuestring[0] != '\0') {
+    size_t len = strlen(content->valuestring);
+    ret = mem_append(&p->content, content->valuestring, len);
+    p->nr_tokens ++;
+    if (ret == 0 && p->on_token) p->on_token(content->valuestring, len, p->userp);
+  }
+
+  cJSON_Delete(chunk);
+  return ret;
+}
+
+// Handles one complete line (without the line terminator)
+static int handle_line(sse_parser_t *p, char *line, size_t len) {
+  if (len > 0 && line[len - 1] == '\r') line[-- len] = '\0';
+
+  // Only "data:" fields matter; comments (":"), "event:", "id:" are skipped
+  if (strncmp(line, "data:", 5) != 0) return 0;
+
+  char *data = line + 5;
+  if (*data == ' ') data ++;
+  return handle_event(p, data);
+}
+
+void sse_init(sse_parser_t *p, aic_token_cb on_token, void *userp) {
+  memset(p, 0, sizeof(*p));
+  p->on_token = on_token;
+  p->userp = userp;
+}
+
+int sse_feed(sse_parser_t *p, const char *data, size_t len) {
+  const char *end = data + len;
+
+  while (data < end) {
+    const char *nl = memchr(data, '\n', end - data);
+    if (nl == NULL) {
+      // Keep the partial line for the next feed
+      return mem_append(&p->line, data, end - data);
+    }
+
+    // Complete the carried-over line (if any) and parse it
+    if (mem_append(&p->line, data, nl - data) != 0) return -1;
+    int ret = handle_line(p, p->line.memory, p->line.size);
+    p->line.size = 0;
+    if (ret != 0) return ret;
+    data = nl + 1;
+  }
+  return 0;
+}
+
+void sse_free(sse_parser_t *p) {
+  SAFE_FREE(p->line.memory);
+  SAFE_FREE(p->content.memory);
+}
@@ -0,0 +1,32 @@
+#ifndef __SSE_H__
+#define __SSE_H__
+
+#include <stddef.h>
+#include "ai_client.h"
+#include "tokens.h"
+
+// Incremental parser for OpenAI-style server-sent event streams.
+// Bytes can be fed in arbitrary pieces; every "data:" line is decoded as a
+// chat.completion.chunk and its delta content is appended and reported.
+typedef struct {
+  MemoryStruct_t line;     // unfinished line carried over between feeds
+  MemoryStruct_t content;  // concatenated delta content so far
+  int nr_events;           // "data:" events seen, including [DONE]
+  int nr_tokens;           // non-empty content deltas seen
+  bool done;               // [DONE] received
+  tok_usage_t usage;       // "usage" of the final chunk, zero if not sent
+  aic_token_cb on_token;
+  void *userp;
+} sse_parser_t;
+
+void sse_init(sse_parser_t *p, aic_token_cb on_token, void *userp);
+
+/**
+ * @brief Feeds raw response bytes to the parser.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int sse_feed(sse_parser_t *p, const char *data, size_t len);
+
+void sse_free(sse_parser_t *p);
+
+#endif
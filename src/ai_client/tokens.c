@@ -0,0 +1,120 @@
+#include <pthread.h>
+#include <string.h>
+#include "common.h"
+#include "tokens.h"
+
+static size_t budgets[NR_AIC_CMD] = {
+  [AIC_CMD_SUGGEST] = AIC_SUGGEST_BUDGET,
+  [AIC_CMD_REPORT]  = AIC_REPORT_BUDGET,
+  [AIC_CMD_CHAT]    = AIC_CHAT_BUDGET,
+};
+
+static aic_token_stats_t stats[NR_AIC_CMD];
+static pthread_mutex_t tok_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef enum { RUN_NONE, RUN_ALPHA, RUN_DIGIT, RUN_PUNCT } run_e;
+
+// Tokens of a run of similar ASCII characters: BPE vocabularies hold common
+// words of about four letters, numbers split into groups of up to three digits
+// and frequent punctuation pairs (JSON's ":" and ",") are merged.
+static size_t run_tokens(run_e kind, size_t len) {
+  switch (kind) {
+    case RUN_ALPHA: return (len + 3) / 4;
+    case RUN_DIGIT: return (len + 2) / 3;
+    case RUN_PUNCT: return (len + 1) / 2;
+    default: return 0;
+  }
+}
+
+size_t aic_estimate_tokens(const char *text, size_t len) {
+  const unsigned char *s = (const unsigned char *)text;
+  size_t tokens = 0, run = 0;
+  run_e kind = RUN_NONE;
+
+  for (size_t i = 0; i < len; ) {
+    unsigned char c = s[i];
+    run_e next;
+
+    if (c >= 0x80) {
+      // Multi-byte UTF-8: CJK ideographs, kana, hangul and full-width
+      // punctuation (3-byte sequences) are about one token per character;
+      // 4-byte characters (emoji, rare ideographs) usually take two
+      tokens += run_tokens(kind, run);
+      kind = RUN_NONE;
+      run = 0;
+      size_t n = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+      tokens += n == 4 ? 2 : 1;
+      i += n;
+      continue;
+    }
+
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') next = RUN_ALPHA;
+    else if (c >= '0' && c <= '9') next = RUN_DIGIT;
+    else if (c == ' ') next = RUN_NONE;   // a space is merged into the next word
+    else next = RUN_PUNCT;                // punctuation, newlines and other controls
+
+    if (next != kind) {
+      tokens += run_tokens(kind, run);
+      kind = next;
+      run = 0;
+    }
+    run ++;
+    i ++;
+  }
+  return tokens + run_tokens(kind, run);
+}
+
+void aic_set_token_budget(aic_cmd_e cmd, size_t tokens) {
+  if (cmd >= 0 && cmd < NR_AIC_CMD) budgets[cmd] = tokens;
+}
+
+size_t aic_get_token_budget(aic_cmd_e cmd) {
+  return (cmd >= 0 && cmd < NR_AIC_CMD) ? budgets[cmd] : 0;
+}
+
+static long usage_field(const cJSON *obj, const char *name) {
+  cJSON *item = cJSON_GetObjectItemCaseSensitive(obj, name);
+  return cJSON_IsNumber(item) ? (long)item->valuedouble : 0;
+}
+
+int tok_read_usage(const cJSON *response, tok_usage_t *usage) {
+  cJSON *u = cJSON_GetObjectItemCaseSensitive(response, "usage");
+
+  if (!cJSON_IsNumber(cJSON_GetObjectItemCaseSensitive(u, "prompt_tokens"))) return -1;
+  usage->prompt_tokens = usage_field(u, "prompt_tokens");
+  usage->completion_tokens = usage_field(u, "completion_tokens");
+
+  if (cJSON_GetObjectItemCaseSensitive(u, "prompt_cache_hit_tokens")) {
+    usage->cache_hit_tokens = usage_field(u, "prompt_cache_hit_tokens");
+    usage->cache_miss_tokens = usage_field(u, "prompt_cache_miss_tokens");
+  } else {
+    cJSON *details = cJSON_GetObjectItemCaseSensitive(u, "prompt_tokens_details");
+    usage->cache_hit_tokens = usage_field(details, "cached_tokens");
+    usage->cache_miss_tokens = usage->prompt_tokens - usage->cache_hit_tokens;
+  }
+  return 0;
+}
+
+void tok_record(aic_cmd_e cmd, size_t estimated, const tok_usage_t *usage, int64_t first_byte_us) {
+  pthread_mutex_lock(&tok_lock);
+  aic_token_stats_t *st = &stats[cmd];
+  st->requests ++;
+  st->estimated += estimated;
+  st->prompt_tokens += usage->prompt_tokens;
+  st->completion_tokens += usage->completion_tokens;
+  st->cache_hit_tokens += usage->cache_hit_tokens;
+  st->cache_miss_tokens += usage->cache_miss_tokens;
+  if (usage->cache_hit_tokens > 0) {
+    st->cached_requests ++;
+    st->cached_first_byte_us += first_byte_us;
+  } else {
+    st->uncached_first_byte_us += first_byte_us;
+  }
+  pthread_mutex_unlock(&tok_lock);
+}
+
+void aic_get_token_stats(aic_cmd_e cmd, aic_token_stats_t *st) {
+  pthread_mutex_lock(&tok_lock);
+  *st = stats[cmd];
+  pthread_mutex_unlock(&tok_lock);
+}
@@ -0,0 +1,30 @@
+#ifndef __TOKENS_H__
+#define __TOKENS_H__
+
+#include "ai_client.h"
+#include "cJSON.h"
+
+// Tokens a request spends around its messages: the chat template's role markers
+#define TOK_REQUEST_OVERHEAD 16
+
+// "usage" of one answer; fields the server did not send stay 0
+typedef struct {
+  long prompt_tokens;
+  long completion_tokens;
+  long cache_hit_tokens;   // prompt tokens served from the server's prefix cache
+  long cache_miss_tokens;
+} tok_usage_t;
+
+/**
+ * @brief Reads "usage" of a chat completion (or of its last stream chunk).
+ * * Cached prompt tokens are read from DeepSeek's prompt_cache_hit_tokens /
+ *   prompt_cache_miss_tokens or OpenAI's prompt_tokens_details.cached_tokens.
+ * @return 0 if prompt_tokens was present, -1 otherwise (usage untouched).
+ */
+int tok_read_usage(const cJSON *response, tok_usage_t *usage);
+
+// Adds one answered request to the token statistics (thread-safe); first_byte_us
+// is the attempt's time to first byte, which the prefix cache shortens
+void tok_record(aic_cmd_e cmd, size_t estimated, const tok_usage_t *usage, int64_t first_byte_us);
+
+#endif
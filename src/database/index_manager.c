@@ -68,6 +68,11 @@ int idx_init(const char* db_file) {
  */
 void idx_shutdown(void) {
     // 1. 将缓存的 Header 写回文件
+    //    数据区末尾由存储层分配块时直接写入文件头，缓存中的值已过期，先取回
+    db_header_t on_disk;
+    if (stg_read_header(&on_disk) == 0) {
+        g_db_header_cache.data_end_offset = on_disk.data_end_offset;
+    }
     if (stg_write_header(&g_db_header_cache) != 0) {
         Log("ERROR: Failed to write final header during shutdown.");
         // 继续尝试写入索引和列表，但不返回
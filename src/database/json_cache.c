@@ -0,0 +1,134 @@
+#include "json_cache.h"
+#include "storage_manager.h"
+#include "common.h"
+
+// 开放寻址 (线性探测) 缓存，以完整的任务 ID 为键。
+// 槽位数是 MAX_TASKS 的两倍，活动任务最多 MAX_TASKS 个，因此不会互相驱逐；
+// 删除任务时用回移法腾出槽位，探测链保持连续。
+// 版本号取自全局递增时钟，条目被删除后重建也不会复用旧版本号。
+// 本模块不加锁：调用方持有 g_json_cache_lock (并行序列化) 或 db_lock。
+#define JSC_SLOTS (MAX_TASKS * 2)
+
+typedef struct {
+    int id;                 // 槽位当前归属的任务 ID (0 表示空)
+    unsigned int version;   // 记录版本号，每次写入/删除时取新的时钟值
+    char *json;             // 紧凑格式的任务 JSON 片段 (NULL 表示未缓存)
+    size_t len;             // 片段长度
+} json_cache_entry_t;
+
+static json_cache_entry_t g_json_cache[JSC_SLOTS];
+static unsigned int g_jsc_clock = 0;
+
+static unsigned int _jsc_home(int id) {
+    return ((unsigned int)id * 2654435761u) % JSC_SLOTS;
+}
+
+// 返回 ID 所在槽位，不存在时返回 NULL
+static json_cache_entry_t *_jsc_find(int id) {
+    if (id <= 0) return NULL;
+    for (unsigned int i = _jsc_home(id), n = 0; n < JSC_SLOTS; i = (i + 1) % JSC_SLOTS, n++) {
+        if (g_json_cache[i].id == id) return &g_json_cache[i];
+        if (g_json_cache[i].id == 0) return NULL;
+    }
+    return NULL;
+}
+
+// 查找或占用一个空槽位；表满时返回 NULL (只会少缓存一项)
+static json_cache_entry_t *_jsc_claim(int id) {
+    for (unsigned int i = _jsc_home(id), n = 0; n < JSC_SLOTS; i = (i + 1) % JSC_SLOTS, n++) {
+        json_cache_entry_t *entry = &g_json_cache[i];
+        if (entry->id == id) return entry;
+        if (entry->id == 0) {
+            entry->id = id;
+            entry->version = 0;
+            entry->json = NULL;
+            entry->len = 0;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 获取任务记录的当前版本号。
+ */
+unsigned int jsc_get_version(int id) {
+    json_cache_entry_t *entry = _jsc_find(id);
+    return entry != NULL ? entry->version : 0;
+}
+
+/**
+ * @brief 查询任务的缓存 JSON 片段。
+ */
+const char *jsc_get(int id, size_t *len_out) {
+    json_cache_entry_t *entry = _jsc_find(id);
+    if (entry == NULL || entry->json == NULL) {
+        return NULL;
+    }
+    if (len_out != NULL) {
+        *len_out = entry->len;
+    }
+    return entry->json;
+}
+
+/**
+ * @brief 写入任务的 JSON 片段，版本号不一致时丢弃。
+ */
+const char *jsc_put(int id, unsigned int version, char *json, size_t len) {
+    json_cache_entry_t *entry = NULL;
+
+    if (id <= 0 || json == NULL || jsc_get_version(id) != version ||
+        (entry = _jsc_claim(id)) == NULL) {
+        free(json);
+        return NULL;
+    }
+
+    free(entry->json);
+    entry->json = json;
+    entry->len = len;
+    return json;
+}
+
+/**
+ * @brief 使任务的缓存片段失效。
+ */
+void jsc_invalidate(int id) {
+    json_cache_entry_t *entry = id > 0 ? _jsc_claim(id) : NULL;
+    if (entry == NULL) return;
+
+    SAFE_FREE(entry->json);
+    entry->len = 0;
+    entry->version = ++g_jsc_clock;
+}
+
+/**
+ * @brief 删除任务的缓存条目，后续条目回移以保持探测链连续。
+ */
+void jsc_remove(int id) {
+    json_cache_entry_t *entry = _jsc_find(id);
+    if (entry == NULL) return;
+
+    SAFE_FREE(entry->json);
+    memset(entry, 0, sizeof(json_cache_entry_t));
+    unsigned int hole = (unsigned int)(entry - g_json_cache);
+    for (unsigned int i = (hole + 1) % JSC_SLOTS; g_json_cache[i].id != 0; i = (i + 1) % JSC_SLOTS) {
+        // 条目的本位不在 (hole, i] 区间内时，才能移到空洞处
+        unsigned int home = _jsc_home(g_json_cache[i].id);
+        bool movable = (hole < i) ? (home <= hole || home > i) : (home <= hole && home > i);
+        if (movable) {
+            g_json_cache[hole] = g_json_cache[i];
+            memset(&g_json_cache[i], 0, sizeof(json_cache_entry_t));
+            hole = i;
+        }
+    }
+}
+
+/**
+ * @brief 释放所有缓存片段。
+ */
+void jsc_clear(void) {
+    for (int i = 0; i < JSC_SLOTS; i++) {
+        SAFE_FREE(g_json_cache[i].json);
+    }
+    memset(g_json_cache, 0, sizeof(g_json_cache));
+}
@@ -0,0 +1,50 @@
+// json_cache.h
+
+#ifndef __JSON_CACHE_H__
+#define __JSON_CACHE_H__
+
+#include <stddef.h>
+#include "database.h"
+
+// --- SERIALIZED TASK CACHE ---
+// Keyed by the full task ID. Not locked: callers serialize access through
+// g_json_cache_lock (parallel serialization) or db_lock.
+
+/**
+ * @brief Returns the current version of a task record.
+ * * The version is bumped by jsc_invalidate(); take it before reading the record
+ *   so a concurrent write can not be cached under the new version.
+ */
+unsigned int jsc_get_version(int id);
+
+/**
+ * @brief Looks up the cached compact JSON of a task.
+ * @param id The task ID.
+ * @param len_out Receives the fragment length (may be NULL).
+ * @return const char* The cached fragment, or NULL on a miss. Owned by the cache.
+ */
+const char *jsc_get(int id, size_t *len_out);
+
+/**
+ * @brief Stores a serialized task, taking ownership of json.
+ * * The fragment is dropped if the record changed since version was taken.
+ * @return const char* The stored fragment, or NULL if it was rejected (json is freed either way).
+ */
+const char *jsc_put(int id, unsigned int version, char *json, size_t len);
+
+/**
+ * @brief Drops the cached fragment of a task and bumps its version.
+ */
+void jsc_invalidate(int id);
+
+/**
+ * @brief Forgets a deleted task. Its version reads as 0 afterwards.
+ */
+void jsc_remove(int id);
+
+/**
+ * @brief Frees every cached fragment.
+ */
+void jsc_clear(void);
+
+#endif
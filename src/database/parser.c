@@ -2,9 +2,15 @@
 #include "database.h"
 #include "common.h"
 #include "cJSON.h"
+#include <math.h>
 #include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <time.h>
 
+// 时间戳上限：9999-12-31 23:59:59 UTC，转换为 time_t 不会越界
+#define PSR_TIME_MAX 253402300799.0
+
 // --- PRIVATE UTILITY ---
 
 /**
@@ -20,19 +26,18 @@ static void _psr_copy_json_string(cJSON *item, char *dest, size_t max_len) {
 // --- PARSER API IMPLEMENTATIONS ---
 
 /**
- * @brief 从 JSON 字符串解析任务数据，填充到 task_t 结构体中。
+ * @brief 内部函数：从已解析的 JSON 对象中读取任务数据。
+ * @param keep_created_at 为 1 时保留 JSON 中的 created_at (用于导入)，否则新建任务使用当前时间。
  */
-int psr_json_to_task(const char *task_json, task_t *task_out, int require_id) {
-    cJSON *root = NULL;
+static int _psr_object_to_task(const cJSON *root, task_t *task_out, int require_id, int keep_created_at) {
     cJSON *item = NULL;
     int result = -1;
     
     // 确保目标结构体清零
     memset(task_out, 0, sizeof(task_t));
 
-    root = cJSON_Parse(task_json);
-    if (root == NULL) {
-        Log("JSON ERROR: Failed to parse input JSON.");
+    if (!cJSON_IsObject(root)) {
+        Log("JSON ERROR: Task is not a JSON object.");
         goto end;
     }
 
@@ -99,23 +104,236 @@ int psr_json_to_task(const char *task_json, task_t *task_out, int require_id) {
     }
 
     // 默认设置/更新 created_at (仅在新建任务时，否则应保持原值)
-    if (require_id == 0) {
+    if (keep_created_at) {
+        item = cJSON_GetObjectItemCaseSensitive(root, "created_at");
+        if (cJSON_IsNumber(item) && item->valuedouble > 0) {
+            task_out->created_at = (time_t)item->valuedouble;
+        }
+    }
+    if (require_id == 0 && task_out->created_at == 0) {
         task_out->created_at = time(NULL);
     }
     
     result = 0; // Success
 
 end:
-    if (root != NULL) {
-        cJSON_Delete(root);
+    return result;
+}
+
+/**
+ * @brief 内部函数：从 JSON 字符串解析任务数据。
+ */
+static int _psr_json_to_task(const char *task_json, task_t *task_out, int require_id, int keep_created_at) {
+    cJSON *root = cJSON_Parse(task_json);
+    int result = -1;
+
+    if (root == NULL) {
+        memset(task_out, 0, sizeof(task_t));
+        Log("JSON ERROR: Failed to parse input JSON.");
+        return -1;
     }
+    result = _psr_object_to_task(root, task_out, require_id, keep_created_at);
+    cJSON_Delete(root);
     return result;
 }
 
 /**
- * @brief 将 task_t 结构体序列化为 JSON 字符串。
+ * @brief 从 JSON 字符串解析任务数据，填充到 task_t 结构体中。
  */
-char* psr_task_to_json(const task_t *task_in) {
+int psr_json_to_task(const char *task_json, task_t *task_out, int require_id) {
+    return _psr_json_to_task(task_json, task_out, require_id, 0);
+}
+
+/**
+ * @brief 解析新任务的 JSON 数组（单个对象视为一个元素），整体校验：任一元素无效则全部拒绝。
+ */
+int psr_json_to_tasks(const char *tasks_json, task_t **tasks_out, int max_count) {
+    cJSON *root = cJSON_Parse(tasks_json);
+    task_t *tasks = NULL;
+    int count = -1;
+
+    *tasks_out = NULL;
+    if (cJSON_IsObject(root)) {
+        // 只有一个任务时模型有时省略数组，按一个元素的数组处理
+        cJSON *array = cJSON_CreateArray();
+        if (array == NULL) goto end;
+        cJSON_AddItemToArray(array, root);
+        root = array;
+    }
+    if (!cJSON_IsArray(root)) {
+        Log("JSON ERROR: Expected a JSON array of tasks.");
+        goto end;
+    }
+
+    int n = cJSON_GetArraySize(root);
+    if (n == 0 || n > max_count) {
+        Log("JSON ERROR: Expected 1 to %d tasks, got %d.", max_count, n);
+        goto end;
+    }
+    tasks = malloc(n * sizeof(task_t));
+    if (tasks == NULL) {
+        Log("ERROR: Memory allocation failed for %d tasks.", n);
+        goto end;
+    }
+
+    // 逐个校验，规则与 task add 相同
+    int i = 0;
+    const cJSON *item = NULL;
+    cJSON_ArrayForEach(item, root) {
+        if (_psr_object_to_task(item, &tasks[i], 0, 0) != 0) {
+            Log("JSON ERROR: Task %d of %d is invalid, nothing added.", i + 1, n);
+            free(tasks);
+            tasks = NULL;
+            goto end;
+        }
+        i ++;
+    }
+    *tasks_out = tasks;
+    count = n;
+
+end:
+    cJSON_Delete(root);
+    return count;
+}
+
+/**
+ * @brief 内部函数：检查可选的整数字段是否在 [min, max] 范围内（缺省时视为合法）。
+ */
+static int _psr_check_int(const cJSON *root, const char *key, double min, double max,
+                          const char *hint, char *err, size_t err_len) {
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(root, key);
+    if (item == NULL || cJSON_IsNull(item)) return 0;
+    // 先比较范围再判断是否为整数：超出范围的值（如 1e300）转换为整数是未定义行为
+    if (cJSON_IsNumber(item) && item->valuedouble >= min && item->valuedouble <= max &&
+        floor(item->valuedouble) == item->valuedouble) {
+        return 0;
+    }
+    snprintf(err, err_len, "\"%s\" must be %s", key, hint);
+    return -1;
+}
+
+/**
+ * @brief 内部函数：按 task_t 模式校验单个任务对象，错误原因写入 err。
+ */
+static int _psr_check_task_object(const cJSON *root, int require_id, char *err, size_t err_len) {
+    const cJSON *item = NULL;
+
+    if (!cJSON_IsObject(root)) {
+        snprintf(err, err_len, "the task must be a JSON object");
+        return -1;
+    }
+    if (require_id) {
+        item = cJSON_GetObjectItemCaseSensitive(root, "id");
+        if (item == NULL) {
+            snprintf(err, err_len, "\"id\" is missing, keep the id of the original task");
+            return -1;
+        }
+        if (_psr_check_int(root, "id", 1, INT32_MAX, "the positive integer id of the original task",
+                           err, err_len) != 0) {
+            return -1;
+        }
+    }
+
+    // 新建任务必须有标题；更新时可以省略，但出现时必须是非空字符串
+    item = cJSON_GetObjectItemCaseSensitive(root, "title");
+    if (item == NULL && !require_id) {
+        snprintf(err, err_len, "\"title\" is missing");
+        return -1;
+    }
+    if (item != NULL && (!cJSON_IsString(item) || item->valuestring[0] == '\0')) {
+        snprintf(err, err_len, "\"title\" must be a non-empty string");
+        return -1;
+    }
+    item = cJSON_GetObjectItemCaseSensitive(root, "description");
+    if (item != NULL && !cJSON_IsNull(item) && !cJSON_IsString(item)) {
+        snprintf(err, err_len, "\"description\" must be a string");
+        return -1;
+    }
+
+    if (_psr_check_int(root, "prio", PRIORITY_URGENT, PRIORITY_LOW,
+                       "an integer from 0 (urgent) to 3 (low)", err, err_len) != 0 ||
+        _psr_check_int(root, "status", TASK_STATUS_TODO, TASK_STATUS_DELETED,
+                       "an integer from 0 (todo) to 3 (deleted)", err, err_len) != 0 ||
+        _psr_check_int(root, "due_date", 0, PSR_TIME_MAX, "a Unix timestamp in seconds",
+                       err, err_len) != 0 ||
+        _psr_check_int(root, "created_at", 0, PSR_TIME_MAX, "a Unix timestamp in seconds",
+                       err, err_len) != 0 ||
+        _psr_check_int(root, "completed_at", 0, PSR_TIME_MAX, "a Unix timestamp in seconds",
+                       err, err_len) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 按 task_t 模式严格校验单个任务 JSON（类型与取值范围）。
+ */
+int psr_check_task(const char *task_json, int require_id, char *err, size_t err_len) {
+    cJSON *root = cJSON_Parse(task_json);
+    int result = -1;
+
+    if (root == NULL) {
+        snprintf(err, err_len, "the answer is not valid JSON");
+        return -1;
+    }
+    result = _psr_check_task_object(root, require_id, err, err_len);
+    cJSON_Delete(root);
+    return result;
+}
+
+/**
+ * @brief 严格校验新任务数组（单个对象视为一个元素），错误原因指明是第几个任务。
+ */
+int psr_check_tasks(const char *tasks_json, int max_count, char *err, size_t err_len) {
+    cJSON *root = cJSON_Parse(tasks_json);
+    int result = -1;
+
+    if (root == NULL) {
+        snprintf(err, err_len, "the answer is not valid JSON");
+        return -1;
+    }
+    if (cJSON_IsObject(root)) {
+        result = _psr_check_task_object(root, 0, err, err_len);
+        goto end;
+    }
+    if (!cJSON_IsArray(root)) {
+        snprintf(err, err_len, "the answer must be a JSON array of task objects");
+        goto end;
+    }
+
+    int n = cJSON_GetArraySize(root);
+    if (n == 0 || n > max_count) {
+        snprintf(err, err_len, "the array must hold 1 to %d tasks, not %d", max_count, n);
+        goto end;
+    }
+    int i = 0;
+    const cJSON *item = NULL;
+    cJSON_ArrayForEach(item, root) {
+        char reason[192];
+        i ++;
+        if (_psr_check_task_object(item, 0, reason, sizeof(reason)) != 0) {
+            snprintf(err, err_len, "task %d of %d: %s", i, n, reason);
+            goto end;
+        }
+    }
+    result = 0;
+
+end:
+    cJSON_Delete(root);
+    return result;
+}
+
+/**
+ * @brief 解析导出的任务 JSON，保留状态与所有时间戳，忽略 ID。
+ */
+int psr_json_to_task_import(const char *task_json, task_t *task_out) {
+    return _psr_json_to_task(task_json, task_out, 0, 1);
+}
+
+/**
+ * @brief 内部函数：将 task_t 结构体序列化为 JSON 字符串，format 控制是否美化输出。
+ */
+static char* _psr_task_to_json(const task_t *task_in, cJSON_bool format) {
     if (task_in == NULL) return NULL;
     
     cJSON *root = cJSON_CreateObject();
@@ -142,7 +360,7 @@ char* psr_task_to_json(const task_t *task_in) {
 
     // 4. 序列化为字符串
     // 使用 cJSON_PrintUnformatted 节省空间，或 cJSON_Print 用于美化输出
-    json_string = cJSON_Print(root);
+    json_string = format ? cJSON_Print(root) : cJSON_PrintUnformatted(root);
     
     cJSON_Delete(root); // 清理 cJSON 树结构
 
@@ -153,6 +371,20 @@ char* psr_task_to_json(const task_t *task_in) {
     return json_string; // 返回的字符串需要调用者 free
 }
 
+/**
+ * @brief 将 task_t 结构体序列化为 JSON 字符串。
+ */
+char* psr_task_to_json(const task_t *task_in) {
+    return _psr_task_to_json(task_in, 1);
+}
+
+/**
+ * @brief 将 task_t 结构体序列化为紧凑格式的 JSON 字符串。
+ */
+char* psr_task_to_json_unformatted(const task_t *task_in) {
+    return _psr_task_to_json(task_in, 0);
+}
+
 /**
  * @brief 将 time_t 时间戳转换为人类可读的字符串格式。
  * @param timestamp 要转换的时间戳。
@@ -204,4 +436,251 @@ const char* psr_priority_string(task_priority_e priority) {
         case PRIORITY_LOW: return "3 - LOW";
         default: return "UNKNOWN";
     }
-}
\ No newline at end of file
+}
+/**
+ * @brief 内部函数：向报表对象追加一个任务列表，只保留报表需要的字段（不含描述）。
+ */
+static void _psr_add_report_list(cJSON *root, const char *name, const task_t *list, int nr) {
+    char time_str[32];
+    cJSON *array = cJSON_AddArrayToObject(root, name);
+    if (array == NULL) return;
+
+    for (int i = 0; i < nr; i++) {
+        cJSON *item = cJSON_CreateObject();
+        if (item == NULL) return;
+        cJSON_AddNumberToObject(item, "id", list[i].id);
+        cJSON_AddStringToObject(item, "title", list[i].title);
+        cJSON_AddNumberToObject(item, "prio", list[i].prio);
+        cJSON_AddStringToObject(item, "status", psr_status_string(list[i].stat));
+        psr_readable_time(list[i].due_date, time_str, sizeof(time_str));
+        cJSON_AddStringToObject(item, "due", time_str);
+        if (list[i].stat == TASK_STATUS_DONE) {
+            psr_readable_time(list[i].completed_at, time_str, sizeof(time_str));
+            cJSON_AddStringToObject(item, "completed", time_str);
+        }
+        cJSON_AddItemToArray(array, item);
+    }
+}
+
+/**
+ * @brief 将报表统计序列化为紧凑 JSON，供报表提示词使用。
+ */
+char* psr_report_to_json(const db_report_t *report, const char *report_type) {
+    char time_str[32];
+    char *json_string = NULL;
+
+    if (report == NULL || report_type == NULL) return NULL;
+
+    cJSON *root = cJSON_CreateObject();
+    if (root == NULL) {
+        Log("JSON ERROR: Failed to create JSON root object.");
+        return NULL;
+    }
+
+    // 1. 报表周期
+    cJSON_AddStringToObject(root, "type", report_type);
+    psr_readable_time(report->window_start, time_str, sizeof(time_str));
+    cJSON_AddStringToObject(root, "period_start", time_str);
+    psr_readable_time(report->now, time_str, sizeof(time_str));
+    cJSON_AddStringToObject(root, "period_end", time_str);
+
+    // 2. 汇总计数
+    cJSON *totals = cJSON_AddObjectToObject(root, "totals");
+    cJSON_AddNumberToObject(totals, "tasks", report->total);
+    cJSON_AddNumberToObject(totals, "created_in_period", report->created);
+    cJSON_AddNumberToObject(totals, "completed_in_period", report->completed);
+    cJSON_AddNumberToObject(totals, "pending_urgent_or_important", report->pending_critical);
+    cJSON_AddNumberToObject(totals, "overdue", report->overdue);
+
+    // 3. 状态与优先级分布
+    cJSON *status = cJSON_AddObjectToObject(root, "by_status");
+    for (int s = TASK_STATUS_TODO; s < TASK_STATUS_DELETED; s++) {
+        cJSON_AddNumberToObject(status, psr_status_string(s), report->by_status[s]);
+    }
+    cJSON *prio = cJSON_AddObjectToObject(root, "by_priority");
+    cJSON *open_prio = cJSON_AddObjectToObject(root, "open_by_priority");
+    for (int p = PRIORITY_URGENT; p <= PRIORITY_LOW; p++) {
+        cJSON_AddNumberToObject(prio, psr_priority_string(p), report->by_prio[p]);
+        cJSON_AddNumberToObject(open_prio, psr_priority_string(p), report->open_by_prio[p]);
+    }
+
+    // 4. 与本周期相关的少量任务
+    _psr_add_report_list(root, "recently_completed", report->completed_list, report->nr_completed_list);
+    _psr_add_report_list(root, "pending_critical", report->critical_list, report->nr_critical_list);
+    _psr_add_report_list(root, "overdue", report->overdue_list, report->nr_overdue_list);
+
+    json_string = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    if (json_string == NULL) {
+        Log("JSON ERROR: Failed to print JSON string.");
+    }
+    return json_string; // 返回的字符串需要调用者 free
+}
+
+// --- COMPACT TABLE ENCODING ---
+
+static const char *_psr_prio_names[] = { "URGENT", "IMPORTANT", "MEDIUM", "LOW" };
+static const char *_psr_status_names[] = { "TODO", "DOING", "DONE", "DELETED" };
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} _psr_text_t;
+
+/**
+ * @brief 内部函数：向文本缓冲区追加格式化内容，按需扩容。
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int _psr_appendf(_psr_text_t *t, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0) return -1;
+
+    if (t->len + n + 1 > t->cap) {
+        size_t cap = t->cap ? t->cap : 256;
+        while (t->len + n + 1 > cap) cap *= 2;
+        char *buf = realloc(t->buf, cap);
+        if (buf == NULL) return -1;
+        t->buf = buf;
+        t->cap = cap;
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(t->buf + t->len, t->cap - t->len, fmt, ap);
+    va_end(ap);
+    t->len += n;
+    return 0;
+}
+
+/**
+ * @brief 内部函数：追加一个表格单元，'|' 替换为 '/'，换行和制表符替换为空格。
+ */
+static int _psr_append_cell(_psr_text_t *t, const char *s) {
+    if (_psr_appendf(t, "|%s", s) != 0) return -1;
+    for (char *c = t->buf + t->len - strlen(s); *c; c++) {
+        if (*c == '|') *c = '/';
+        else if (*c == '\n' || *c == '\r' || *c == '\t') *c = ' ';
+    }
+    return 0;
+}
+
+void psr_relative_time(time_t timestamp, time_t now, char *buffer, size_t buffer_size) {
+    if (timestamp == 0) {
+        buffer[0] = '\0';
+        return;
+    }
+    long diff = (long)(timestamp - now);
+    if (diff > -86400 && diff < 86400) {
+        snprintf(buffer, buffer_size, "%+ldh", diff / 3600);
+    } else {
+        snprintf(buffer, buffer_size, "%+ldd", diff / 86400);
+    }
+}
+
+const char* psr_task_table_header(void) {
+    return "id|title|description|prio|status|due|created|done";
+}
+
+/**
+ * @brief 内部函数：追加一行任务。full 为 0 时省略描述和创建时间（报表列表）。
+ */
+static int _psr_append_row(_psr_text_t *t, const task_t *task, time_t now, int full) {
+    char due[24], created[24], done[24];
+    const char *cells[7];
+    int nr_cells = 0;
+
+    psr_relative_time(task->due_date, now, due, sizeof(due));
+    psr_relative_time(task->created_at, now, created, sizeof(created));
+    psr_relative_time(task->stat == TASK_STATUS_DONE ? task->completed_at : 0, now, done, sizeof(done));
+
+    cells[nr_cells++] = task->title;
+    if (full) cells[nr_cells++] = task->description;
+    cells[nr_cells++] = (task->prio >= PRIORITY_URGENT && task->prio <= PRIORITY_LOW) ?
+        _psr_prio_names[task->prio] : "";
+    cells[nr_cells++] = (task->stat >= TASK_STATUS_TODO && task->stat <= TASK_STATUS_DELETED) ?
+        _psr_status_names[task->stat] : "";
+    cells[nr_cells++] = due;
+    if (full) cells[nr_cells++] = created;
+    cells[nr_cells++] = done;
+
+    // 行尾的空字段不输出
+    while (nr_cells > 0 && cells[nr_cells - 1][0] == '\0') nr_cells--;
+
+    if (_psr_appendf(t, "%d", task->id) != 0) return -1;
+    for (int i = 0; i < nr_cells; i++) {
+        if (_psr_append_cell(t, cells[i]) != 0) return -1;
+    }
+    return 0;
+}
+
+char* psr_task_to_row(const task_t *task, time_t now) {
+    _psr_text_t t = { 0 };
+
+    if (task == NULL) return NULL;
+    if (_psr_append_row(&t, task, now, 1) != 0) {
+        free(t.buf);
+        return NULL;
+    }
+    return t.buf;
+}
+
+/**
+ * @brief 内部函数：追加报表中的一个任务列表（表头 + 每任务一行）。
+ */
+static int _psr_append_report_list(_psr_text_t *t, const char *name, const task_t *list, int nr, time_t now) {
+    if (nr == 0) return _psr_appendf(t, "%s: none\n", name);
+    if (_psr_appendf(t, "%s:\nid|title|prio|status|due|done\n", name) != 0) return -1;
+    for (int i = 0; i < nr; i++) {
+        if (_psr_append_row(t, &list[i], now, 0) != 0) return -1;
+        if (_psr_appendf(t, "\n") != 0) return -1;
+    }
+    return 0;
+}
+
+char* psr_report_to_table(const db_report_t *report, const char *report_type) {
+    _psr_text_t t = { 0 };
+    char start[24];
+    int ret = 0;
+
+    if (report == NULL || report_type == NULL) return NULL;
+
+    // 1. 报表周期与汇总计数
+    psr_relative_time(report->window_start, report->now, start, sizeof(start));
+    ret |= _psr_appendf(&t, "type=%s period_start=%s period_end=now\n", report_type, start);
+    ret |= _psr_appendf(&t, "totals: tasks=%d created_in_period=%d completed_in_period=%d "
+                            "pending_urgent_or_important=%d overdue=%d\n",
+                        report->total, report->created, report->completed,
+                        report->pending_critical, report->overdue);
+
+    // 2. 状态与优先级分布
+    ret |= _psr_appendf(&t, "by_status:");
+    for (int s = TASK_STATUS_TODO; s < TASK_STATUS_DELETED; s++) {
+        ret |= _psr_appendf(&t, " %s=%d", _psr_status_names[s], report->by_status[s]);
+    }
+    ret |= _psr_appendf(&t, "\nby_priority:");
+    for (int p = PRIORITY_URGENT; p <= PRIORITY_LOW; p++) {
+        ret |= _psr_appendf(&t, " %s=%d", _psr_prio_names[p], report->by_prio[p]);
+    }
+    ret |= _psr_appendf(&t, "\nopen_by_priority:");
+    for (int p = PRIORITY_URGENT; p <= PRIORITY_LOW; p++) {
+        ret |= _psr_appendf(&t, " %s=%d", _psr_prio_names[p], report->open_by_prio[p]);
+    }
+    ret |= _psr_appendf(&t, "\n");
+
+    // 3. 与本周期相关的少量任务
+    ret |= _psr_append_report_list(&t, "recently_completed", report->completed_list, report->nr_completed_list, report->now);
+    ret |= _psr_append_report_list(&t, "pending_critical", report->critical_list, report->nr_critical_list, report->now);
+    ret |= _psr_append_report_list(&t, "overdue", report->overdue_list, report->nr_overdue_list, report->now);
+
+    if (ret != 0) {
+        Log("ERROR: Failed to encode the report table.");
+        free(t.buf);
+        return NULL;
+    }
+    return t.buf; // 返回的字符串需要调用者 free
+}
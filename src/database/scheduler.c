@@ -0,0 +1,200 @@
+#include <string.h>
+#include "scheduler.h"
+#include "index_manager.h"
+#include "storage_manager.h"
+#include "common.h"
+
+// 没有截止时间的任务按创建后一周到期参与排序
+#define SCH_NO_DUE_HORIZON (7 * 24 * 60 * 60)
+
+// 小顶堆条目：保存计算分数所需的字段，修改权重时无需重新读盘
+typedef struct {
+    int id;
+    int prio;
+    time_t due;             // 有效截止时间
+    time_t created_at;
+    double key;             // 分数，越小越先做
+} sch_entry_t;
+
+static sch_entry_t g_heap[MAX_TASKS];
+static int g_heap_size = 0;
+
+static db_sched_weights_t g_weights = {
+    .prio_hours = 24.0,     // 提高一级优先级相当于截止时间提前一天
+    .due_weight = 1.0,
+    .age_weight = 0.1,      // 早创建 10 天相当于截止时间提前一天
+};
+
+/**
+ * @brief 计算任务分数。
+ * * 分数 = due_weight * (due - now) - age_weight * (now - created_at) + prio * prio_hours，
+ *   其中与 now 相关的项对所有任务相同，省略后分数与当前时间无关，
+ *   因此堆的顺序只在任务增删改或权重变化时才需要调整。
+ */
+static double _sch_key(const sch_entry_t *entry) {
+    return g_weights.due_weight * (double)entry->due +
+           g_weights.age_weight * (double)entry->created_at +
+           g_weights.prio_hours * 3600.0 * entry->prio;
+}
+
+static void _sch_swap(int a, int b) {
+    sch_entry_t tmp = g_heap[a];
+    g_heap[a] = g_heap[b];
+    g_heap[b] = tmp;
+}
+
+// 分数相同时 ID 小的优先，保证结果确定
+static int _sch_less(const sch_entry_t *a, const sch_entry_t *b) {
+    return a->key < b->key || (a->key == b->key && a->id < b->id);
+}
+
+static void _sch_sift_up(sch_entry_t *heap, int pos) {
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!_sch_less(&heap[pos], &heap[parent])) break;
+        sch_entry_t tmp = heap[pos];
+        heap[pos] = heap[parent];
+        heap[parent] = tmp;
+        pos = parent;
+    }
+}
+
+static void _sch_sift_down(sch_entry_t *heap, int size, int pos) {
+    for (;;) {
+        int best = pos;
+        int left = 2 * pos + 1;
+        int right = left + 1;
+        if (left < size && _sch_less(&heap[left], &heap[best])) best = left;
+        if (right < size && _sch_less(&heap[right], &heap[best])) best = right;
+        if (best == pos) break;
+        sch_entry_t tmp = heap[pos];
+        heap[pos] = heap[best];
+        heap[best] = tmp;
+        pos = best;
+    }
+}
+
+// 堆最多 MAX_TASKS 个条目，线性查找的开销远小于一次磁盘读
+static int _sch_find(int id) {
+    for (int i = 0; i < g_heap_size; i++) {
+        if (g_heap[i].id == id) return i;
+    }
+    return -1;
+}
+
+static void _sch_fill(sch_entry_t *entry, const task_t *task) {
+    entry->id = task->id;
+    entry->prio = task->prio;
+    entry->due = task->due_date ? task->due_date : task->created_at + SCH_NO_DUE_HORIZON;
+    entry->created_at = task->created_at;
+    entry->key = _sch_key(entry);
+}
+
+static void _sch_heapify(void) {
+    for (int i = g_heap_size / 2 - 1; i >= 0; i--) {
+        _sch_sift_down(g_heap, g_heap_size, i);
+    }
+}
+
+/**
+ * @brief 遍历索引，用所有 TODO/DOING 任务重建堆。
+ */
+int sch_rebuild(void) {
+    int task_count = 0;
+    const index_record_t *index_p = idx_get_index(&task_count);
+    task_t task;
+
+    g_heap_size = 0;
+    if (index_p == NULL) return 0;
+
+    for (int i = 0; i < task_count; i++) {
+        if (stg_read_task_block(index_p[i].offset, &task) != 0) {
+            Log("ERROR: Failed to read task block for index %d.", i);
+            continue;
+        }
+        if (task.stat != TASK_STATUS_TODO && task.stat != TASK_STATUS_DOING) continue;
+        _sch_fill(&g_heap[g_heap_size++], &task);
+    }
+    _sch_heapify();
+    return 0;
+}
+
+/**
+ * @brief 插入或更新任务的堆条目，任务不再处于打开状态时移除。
+ */
+void sch_update(const task_t *task) {
+    if (task == NULL || task->id <= 0) return;
+    if (task->stat != TASK_STATUS_TODO && task->stat != TASK_STATUS_DOING) {
+        sch_remove(task->id);
+        return;
+    }
+
+    int pos = _sch_find(task->id);
+    if (pos < 0) {
+        if (g_heap_size >= MAX_TASKS) {
+            Log("WARN: Scheduler heap is full, task %d not scheduled.", task->id);
+            return;
+        }
+        pos = g_heap_size++;
+    }
+    _sch_fill(&g_heap[pos], task);
+    _sch_sift_up(g_heap, pos);
+    _sch_sift_down(g_heap, g_heap_size, pos);
+}
+
+/**
+ * @brief 从堆中移除任务。
+ */
+void sch_remove(int id) {
+    int pos = _sch_find(id);
+    if (pos < 0) return;
+
+    _sch_swap(pos, --g_heap_size);
+    if (pos < g_heap_size) {
+        _sch_sift_up(g_heap, pos);
+        _sch_sift_down(g_heap, g_heap_size, pos);
+    }
+}
+
+/**
+ * @brief 清空堆。
+ */
+void sch_clear(void) {
+    g_heap_size = 0;
+}
+
+/**
+ * @brief 设置分数权重并重新计算所有条目的分数。
+ */
+void sch_set_weights(const db_sched_weights_t *weights) {
+    if (weights == NULL) return;
+    g_weights = *weights;
+    for (int i = 0; i < g_heap_size; i++) {
+        g_heap[i].key = _sch_key(&g_heap[i]);
+    }
+    _sch_heapify();
+}
+
+void sch_get_weights(db_sched_weights_t *weights) {
+    if (weights != NULL) *weights = g_weights;
+}
+
+/**
+ * @brief 取出分数最小的 n 个任务 ID。
+ * * 在堆的副本上弹出 n 次，原堆保持不变，复杂度 O(size + n log size)。
+ */
+int sch_top(int n, int *ids_out) {
+    static sch_entry_t scratch[MAX_TASKS];
+    int size = g_heap_size;
+
+    if (ids_out == NULL || n <= 0) return 0;
+    if (n > size) n = size;
+
+    memcpy(scratch, g_heap, size * sizeof(sch_entry_t));
+    for (int i = 0; i < n; i++) {
+        ids_out[i] = scratch[0].id;
+        scratch[0] = scratch[--size];
+        _sch_sift_down(scratch, size, 0);
+    }
+    return n;
+}
@@ -0,0 +1,42 @@
+// scheduler.h
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include "database.h"
+
+// --- NEXT-TASK SCHEDULER ---
+
+/**
+ * @brief Rebuilds the heap of open tasks from the index (after idx_init()).
+ */
+int sch_rebuild(void);
+
+/**
+ * @brief Inserts or re-keys a task; tasks that are no longer TODO/DOING are removed.
+ */
+void sch_update(const task_t *task);
+
+/**
+ * @brief Removes a task from the heap (no-op if it is not there).
+ */
+void sch_remove(int id);
+
+/**
+ * @brief Drops every heap entry.
+ */
+void sch_clear(void);
+
+/**
+ * @brief Replaces the score weights and re-heapifies without touching the disk.
+ */
+void sch_set_weights(const db_sched_weights_t *weights);
+void sch_get_weights(db_sched_weights_t *weights);
+
+/**
+ * @brief Copies the IDs of the n best-scored open tasks, best first.
+ * @return int Number of IDs written (at most n).
+ */
+int sch_top(int n, int *ids_out);
+
+#endif
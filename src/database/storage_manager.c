@@ -245,6 +245,18 @@ int stg_read_task_block(long offset, task_t *task) {
     return 0;
 }
 
+/**
+ * @brief 线程安全地从指定偏移量读取单个任务数据块 (不移动共享文件指针)。
+ */
+int stg_pread_task_block(long offset, task_t *task) {
+    if (g_db_file == NULL) return -1;
+
+    // 所有写操作都会立即 fflush，因此文件描述符上的数据总是最新的
+    if (pread(fileno(g_db_file), task, TASK_RECORD_SIZE, offset) != (ssize_t)TASK_RECORD_SIZE) return -1;
+
+    return 0;
+}
+
 /**
  * @brief 将单个任务数据块写入指定偏移量。
  */
@@ -262,6 +274,22 @@ int stg_write_task_block(long offset, const task_t *task) {
     return 0;
 }
 
+/**
+ * @brief 将连续多个任务数据块一次性写入指定偏移量 (批量导入使用)。
+ */
+int stg_write_task_blocks(long offset, const task_t *tasks, int count) {
+    if (g_db_file == NULL || count <= 0) return -1;
+    if (fseek(g_db_file, offset, SEEK_SET) != 0) return -1;
+
+    if (fwrite(tasks, TASK_RECORD_SIZE, count, g_db_file) != (size_t)count) {
+        fflush(g_db_file);
+        return -1;
+    }
+    fflush(g_db_file); // 整批写入后只刷新一次
+
+    return 0;
+}
+
 /**
  * @brief 从空闲列表或文件末尾分配一个任务数据块的空间。
  * @return long 分配到的起始字节偏移量，-1 表示失败。
@@ -317,6 +345,26 @@ long stg_allocate_block(void) {
     return allocated_offset;
 }
 
+/**
+ * @brief 从文件末尾一次性追加 count 个连续的任务数据块。
+ * @return long 第一个块的起始字节偏移量，-1 表示失败。
+ */
+long stg_allocate_blocks(int count) {
+    db_header_t header;
+    long allocated_offset;
+
+    if (count <= 0 || stg_read_header(&header) != 0) {
+        return -1;
+    }
+
+    allocated_offset = header.data_end_offset;
+    header.data_end_offset += (long)count * TASK_RECORD_SIZE;
+
+    if (stg_write_header(&header) != 0) return -1;
+
+    return allocated_offset;
+}
+
 /**
  * @brief 释放一个任务数据块的空间，将其添加到空闲列表。
  * @param offset 被释放块的起始字节偏移量。
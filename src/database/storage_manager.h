@@ -75,6 +75,14 @@ void stg_print_header(const db_header_t *header) ;
  */
 int stg_read_task_block(long offset, task_t *task);
 
+/**
+ * @brief Thread-safe variant of stg_read_task_block().
+ * * Uses pread() on the underlying descriptor, so it neither moves nor depends on
+ *   the shared FILE position. Safe as long as no writer runs concurrently.
+ * @return int 0 on success, -1 on failure.
+ */
+int stg_pread_task_block(long offset, task_t *task);
+
 /**
  * @brief Write single task data block to specified offset.
  * @param offset Starting offset of task record in file.
@@ -83,6 +91,22 @@ int stg_read_task_block(long offset, task_t *task);
  */
 int stg_write_task_block(long offset, const task_t *task);
 
+/**
+ * @brief Write consecutive task data blocks with a single I/O call.
+ * @param offset Starting offset of the first record in file.
+ * @param tasks Array of count task_t structures to write.
+ * @param count Number of records.
+ * @return int 0 on success, -1 on failure.
+ */
+int stg_write_task_blocks(long offset, const task_t *tasks, int count);
+
 long stg_allocate_block(void);
 
+/**
+ * @brief Append count contiguous task blocks at the end of the data area.
+ * * Unlike stg_allocate_block(), never takes blocks from the free list.
+ * @return long Offset of the first block, -1 on failure.
+ */
+long stg_allocate_blocks(int count);
+
 #endif
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include "adb.h"
@@ -9,38 +11,78 @@
 static int cmd_dispatch(cmd_t *subcmd_table, int NR_SUBCMD, char *args);
 static int cmd_help(char *args);
 static int cmd_quit(char *args);
+static int cmd_jobs(char *args);
+static int cmd_wait(char *args);
 
 static int cmd_task(char *args);
 static int subcmd_task_add(char *args);
+static int subcmd_task_batch(char *args);
+static int subcmd_task_multi(char *args);
 static int subcmd_task_list(char *args);
 static int subcmd_task_del(char *args);
 static int subcmd_task_update(char *args);
+static int subcmd_task_export(char *args);
+static int subcmd_task_import(char *args);
+static int subcmd_task_next(char *args);
 
 static int cmd_ai(char *args);
 static int subcmd_ai_chat(char *args);
+static int subcmd_ai_history(char *args);
+static int subcmd_ai_forget(char *args);
 static int subcmd_ai_sug(char *args);
+static int subcmd_ai_timing(char *args);
+static int subcmd_ai_cache(char *args);
+static int subcmd_ai_local(char *args);
+static int subcmd_ai_latency(char *args);
+static int subcmd_ai_tokens(char *args);
+static int subcmd_ai_routes(char *args);
+static int subcmd_ai_json(char *args);
+static int subcmd_ai_queue(char *args);
 
 static int cmd_report(char *args);
 static int subcmd_report_w(char *args);
 static int subcmd_report_m(char *args);
+
+static int cmd_bench(char *args);
+static int subcmd_bench_json(char *args);
+static int subcmd_bench_prompt(char *args);
+static uint64_t get_time_us();
 static cmd_t cmd_table [] = {
   { "help"  , "Display information about all supported commands", cmd_help },
   { "quit"  , "Quit Ass-Igned", cmd_quit },
+  { "jobs"  , "List background AI jobs (end an AI command with '&' to start one)", cmd_jobs },
+  { "wait"  , "Wait for background jobs: wait [job_id]", cmd_wait },
   { "task"  , "Basic task commands", cmd_task },
   { "ai"    , "Basic AI commands", cmd_ai },
-  { "report", "Generate weekly/monthly summary reports", cmd_report }
+  { "report", "Generate weekly/monthly summary reports", cmd_report },
+  { "bench" , "Run performance benchmarks", cmd_bench }
 };
 
 static cmd_t subcmd_task_table [] = {
   { "list"    , "List all tasks", subcmd_task_list },
   { "add"     , "Add a task", subcmd_task_add },
+  { "batch"   , "Add one task per line: task batch [file|-] [max_inflight]", subcmd_task_batch },
+  { "multi"   , "Add every task described in one text with a single AI call", subcmd_task_multi },
   { "del"     , "Delete a tasks", subcmd_task_del },
   { "update"  , "Delete a tasks", subcmd_task_update },
+  { "export"  , "Export all tasks to a NDJSON file", subcmd_task_export },
+  { "import"  , "Import tasks from a NDJSON file", subcmd_task_import },
+  { "next"    , "Show the N tasks to do next, scored locally: task next [N]", subcmd_task_next },
 };
 
 static cmd_t subcmd_ai_table [] = {
-  { "chat", "Chat with AI", subcmd_ai_chat },
-  { "sug", "Get AI suggestion for the next task", subcmd_ai_sug }
+  { "chat", "Chat with AI; earlier messages are remembered within the chat budget", subcmd_ai_chat },
+  { "history", "Show the chat memory: summary of older turns and the turns kept verbatim", subcmd_ai_history },
+  { "forget", "Clear the chat memory", subcmd_ai_forget },
+  { "sug", "Get AI suggestion for the next task: ai sug [K] (K: only send the top K scored tasks)", subcmd_ai_sug },
+  { "timing", "Show DNS/connect/TLS/TTFB timing of the last AI request", subcmd_ai_timing },
+  { "cache", "Show AI response cache statistics", subcmd_ai_cache },
+  { "local", "Show how many task adds were parsed locally", subcmd_ai_local },
+  { "latency", "Show p50/p95/p99 latency, retries, hedges and shared requests per AI command", subcmd_ai_latency },
+  { "tokens", "Show token budgets, estimated vs. reported prompt tokens and prefix cache hits", subcmd_ai_tokens },
+  { "routes", "Show the model, endpoint and parameters of each AI command next to its latency", subcmd_ai_routes },
+  { "json", "Show how AI JSON answers passed the task schema and how often they were re-prompted", subcmd_ai_json },
+  { "queue", "Show AI requests queued while the endpoint was unreachable: ai queue [retry]", subcmd_ai_queue }
 };
 
 static cmd_t subcmd_report_table [] = {
@@ -48,6 +90,11 @@ static cmd_t subcmd_report_table [] = {
   { "monthly", "Generate a monthly task summary report", subcmd_report_m }
 };
 
+static cmd_t subcmd_bench_table [] = {
+  { "json", "Task list JSON serialization scaling: bench json [max_threads] [rounds]", subcmd_bench_json },
+  { "prompt", "Size and estimated tokens of the prompt data encodings", subcmd_bench_prompt }
+};
+
 #define NR_CMD         ARRLEN(cmd_table)
 #define NR_SUBCMD(x)   ARRLEN(subcmd_ ## x ## _table)
 
@@ -59,6 +106,7 @@ static char* rl_gets() {
     line_read = NULL;
   }
 
+  jobs_report();
   line_read = readline(ANSI_FMT("(ass) ", ANSI_FG_GREEN));
 
   if (line_read && *line_read) {
@@ -97,6 +145,30 @@ static int cmd_quit(char *args) {
   return -1;
 }
 
+static int cmd_jobs(char *args) {
+  jobs_list();
+  return 0;
+}
+
+static int cmd_wait(char *args) {
+  char *arg = strtok(NULL, " ");
+  int id = arg ? atoi(arg) : 0;
+
+  if (jobs_wait(id) != 0) {
+    _Log("No such job: %s\n", arg);
+  }
+  return 0;
+}
+
+// Shows finished background jobs while readline waits for input
+static int job_event_hook() {
+  if (!jobs_have_news()) return 0;
+  printf("\r\033[K");
+  jobs_report();
+  rl_forced_update_display();
+  return 0;
+}
+
 static int cmd_dispatch(cmd_t *subcmd_table, int NR_SUBCMD, char *args) {
   char *subcmd = strtok(NULL, " ");
   int i;
@@ -128,14 +200,36 @@ static int cmd_task(char *args) {
   return cmd_dispatch(subcmd_task_table, NR_SUBCMD(task), args);
 }
 
-static int subcmd_task_add(char *args) {
-  SAFE_FREE(answer);
+// A replayed request may have been committed before a crash lost its queue update
+static bool already_added(const job_t *job, const task_t *task) {
+  return job->queued_at != 0 && db_find_same_task(task, job->queued_at) > 0;
+}
 
+static int finish_task_add(job_t *job, const char *result) {
+  task_t task;
+  job_printf(job, "%s\n", result);
+  if (job->queued_at != 0 && psr_json_to_task(result, &task, 0) == 0 && already_added(job, &task)) {
+    job_printf(job, "Already added.\n");
+    return 0;
+  }
+  return db_add_task(result) > 0 ? 0 : -1;
+}
+
+static int subcmd_task_add(char *args) {
   if (args == NULL || *args == '\0') {
     _Log("Usage: task add <prompt>\n");
     return -1;
   }
 
+  // Formulaic input ("明天下午3点 交周报 紧急") needs no round trip
+  char *local = aic_task_add_local(args);
+  if (local != NULL) {
+    _Log("%s (parsed locally)\n", local);
+    int ret = db_add_task(local) > 0 ? 0 : -1;
+    free(local);
+    return ret;
+  }
+
   char* prompt = NULL;
   prompt = aic_task_add_prompt(args);
   if (prompt == NULL) {
@@ -143,17 +237,177 @@ static int subcmd_task_add(char *args) {
     return -1;
   }
 
-  answer = aic_call(prompt);
-
-  if (answer == NULL) {
+  if (job_submit(AIC_CMD_TASK_ADD, aic_prompt_wrap(prompt), finish_task_add, NULL, NULL) != 0) {
     Log("AI task add error");
     return -1;
   }
-  printf("%s\n", answer);
-  db_add_task(answer);
+  return 0;
+}
+
+// Validates the whole array first, then adds the tasks in one batch
+static int finish_task_multi(job_t *job, const char *result) {
+  task_t *tasks = NULL;
+  int count = psr_json_to_tasks(result, &tasks, AIC_MULTI_MAX);
+
+  if (count < 0) {
+    job_printf(job, "Invalid answer, no task added:\n%s\n", result);
+    return -1;
+  }
+  int nr_new = 0;
+  for (int i = 0; i < count; i ++) {
+    if (!already_added(job, &tasks[i])) tasks[nr_new ++] = tasks[i];
+  }
+  if (nr_new < count) job_printf(job, "%d tasks were already added.\n", count - nr_new);
+  count = nr_new;
+  if (count == 0) {
+    free(tasks);
+    return 0;
+  }
+  int nr_added = db_add_tasks(tasks, count);
+  for (int i = 0; i < nr_added; i ++) {
+    char *json = psr_task_to_json_unformatted(&tasks[i]);
+    job_printf(job, "%s\n", json ? json : tasks[i].title);
+    free(json);
+  }
+  job_printf(job, "Added %d of %d tasks.\n", nr_added > 0 ? nr_added : 0, count);
+  free(tasks);
+  return nr_added == count ? 0 : -1;
+}
+
+static int subcmd_task_multi(char *args) {
+  if (args == NULL || *args == '\0') {
+    _Log("Usage: task multi <text describing one or more tasks>\n");
+    return -1;
+  }
+
+  char *prompt = aic_task_multi_prompt(args);
+  if (prompt == NULL) {
+    Log("Failed to build prompt");
+    return -1;
+  }
 
-  SAFE_FREE(answer);
-  free(prompt);
+  if (job_submit(AIC_CMD_TASK_MULTI, aic_prompt_wrap(prompt), finish_task_multi, NULL, NULL) != 0) {
+    Log("AI task multi error");
+    return -1;
+  }
+  return 0;
+}
+
+// Reads non-empty lines from fp; on a terminal input ends at a line holding only "."
+static char **read_batch_lines(FILE *fp, int *count) {
+  char **lines = NULL;
+  int nr = 0, cap = 0;
+  char buf[1024];
+  bool tty = isatty(fileno(fp));
+
+  if (tty) _Log("Enter one task per line, finish with a single '.':\n");
+  while (fgets(buf, sizeof(buf), fp) != NULL) {
+    buf[strcspn(buf, "\r\n")] = '\0';
+    if (tty && strcmp(buf, ".") == 0) break;
+    char *p = buf;
+    while (*p == ' ' || *p == '\t') p ++;
+    if (*p == '\0') continue;
+
+    if (nr == cap) {
+      cap = cap ? cap * 2 : 16;
+      lines = realloc(lines, cap * sizeof(char *));
+      if (!lines) panic("Memory allocation failed for batch lines.");
+    }
+    lines[nr] = strdup(p);
+    if (!lines[nr]) panic("Memory allocation failed for batch lines.");
+    nr ++;
+  }
+  *count = nr;
+  return lines;
+}
+
+typedef struct {
+  char **lines;
+  char **locals;     // task JSON of lines parsed locally, NULL for the rest
+  int *remote_line;  // line index of each request sent to the AI
+  int next_line;     // first line not committed yet
+  int nr_added;
+} task_batch_t;
+
+static void batch_commit(task_batch_t *batch, int line, char *result) {
+  if (result == NULL) {
+    _Log("[%d] FAILED: %s\n", line + 1, batch->lines[line]);
+    return;
+  }
+  _Log("[%d] %s\n", line + 1, result);
+  if (db_add_task(result) > 0) batch->nr_added ++;
+  free(result);
+}
+
+// Commits locally parsed lines that come before line
+static void batch_commit_locals(task_batch_t *batch, int line) {
+  for (; batch->next_line < line; batch->next_line ++) {
+    batch_commit(batch, batch->next_line, batch->locals[batch->next_line]);
+    batch->locals[batch->next_line] = NULL;
+  }
+}
+
+// Called in input order, so tasks get ids in the order they were written
+static void on_batch_result(int index, char *result, void *userp) {
+  task_batch_t *batch = userp;
+  int line = batch->remote_line[index];
+
+  batch_commit_locals(batch, line);
+  batch_commit(batch, line, result);
+  batch->next_line = line + 1;
+}
+
+static int subcmd_task_batch(char *args) {
+  char *path = strtok(NULL, " ");
+  char *inflight_str = strtok(NULL, " ");
+  int max_inflight = inflight_str ? atoi(inflight_str) : AIC_BATCH_INFLIGHT;
+  FILE *fp = stdin;
+
+  if (path != NULL && strcmp(path, "-") != 0) {
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+      _Log("Error: Cannot open '%s'.\n", path);
+      return -1;
+    }
+  }
+
+  int count = 0;
+  char **lines = read_batch_lines(fp, &count);
+  if (fp != stdin) fclose(fp);
+  if (count == 0) {
+    _Log("INFO: No tasks given.\n");
+    free(lines);
+    return 0;
+  }
+
+  char **prompts = malloc(count * sizeof(char *));
+  char **locals = calloc(count, sizeof(char *));
+  int *remote_line = malloc(count * sizeof(int));
+  if (!prompts || !locals || !remote_line) panic("Memory allocation failed for batch prompts.");
+
+  // Lines the local parser understands skip the AI entirely
+  int nr_remote = 0;
+  for (int i = 0; i < count; i ++) {
+    locals[i] = aic_task_add_local(lines[i]);
+    if (locals[i]) continue;
+    prompts[nr_remote] = aic_task_add_prompt(lines[i]);
+    if (!prompts[nr_remote]) panic("Failed to build prompt");
+    remote_line[nr_remote ++] = i;
+  }
+
+  task_batch_t batch = { .lines = lines, .locals = locals, .remote_line = remote_line };
+  _Log("INFO: Parsing %d tasks (%d locally), up to %d at a time...\n",
+      count, count - nr_remote, max_inflight);
+  aic_call_batch(AIC_CMD_TASK_ADD, prompts, nr_remote, max_inflight, on_batch_result, &batch);
+  batch_commit_locals(&batch, count);
+  _Log("Success: %d of %d tasks added.\n", batch.nr_added, count);
+
+  for (int i = 0; i < nr_remote; i ++) free(prompts[i]);
+  for (int i = 0; i < count; i ++) free(lines[i]);
+  free(prompts);
+  free(locals);
+  free(remote_line);
+  free(lines);
   return 0;
 }
 
@@ -162,6 +416,99 @@ static int subcmd_task_list(char *args) {
   return 0;
 }
 
+#define TASK_NEXT_DEFAULT 5
+
+static int subcmd_task_next(char *args) {
+  char *arg = strtok(NULL, " ");
+  int n = arg ? atoi(arg) : TASK_NEXT_DEFAULT;
+
+  if (n <= 0) {
+    _Log("Usage: task next [N]\n");
+    return -1;
+  }
+  if (n > db_get_task_count()) n = db_get_task_count();
+
+  task_t *next = malloc((n > 0 ? n : 1) * sizeof(task_t));
+  if (next == NULL) return -1;
+
+  uint64_t start = get_time_us();
+  int found = db_next_tasks(n, next);
+  uint64_t elapsed = get_time_us() - start;
+  if (found <= 0) {
+    free(next);
+    if (found < 0) {
+      Log("Failed to query the scheduler.");
+      return -1;
+    }
+    _Log("INFO: No open tasks.\n");
+    return 0;
+  }
+
+  char due[32];
+  for (int i = 0; i < found; i++) {
+    psr_readable_time(next[i].due_date, due, sizeof(due));
+    _Log("%2d. [%d] %-32s %-13s %-5s due %s\n", i + 1, next[i].id, next[i].title,
+        psr_priority_string(next[i].prio), psr_status_string(next[i].stat), due);
+  }
+  _Log("(%d tasks in %lu us)\n", found, (unsigned long)elapsed);
+  free(next);
+  return 0;
+}
+
+/**
+ * Encodes the k best-scored open tasks like db_get_task_list_within() does, so
+ * the suggestion prompt only carries the candidates instead of the whole list.
+ */
+static char *top_tasks_list(int k, db_format_e format, time_t now, int *nr_found) {
+  bool table = (format == DB_FORMAT_TABLE);
+  const char *head = table ? psr_task_table_header() : "[";
+  const char *tail = table ? "" : "]";
+
+  if (k > db_get_task_count()) k = db_get_task_count();
+
+  task_t *top = malloc((k > 0 ? k : 1) * sizeof(task_t));
+  if (top == NULL) return NULL;
+  int found = db_next_tasks(k, top);
+  if (found < 0) {
+    free(top);
+    return NULL;
+  }
+  *nr_found = found;
+
+  size_t cap = strlen(head) + strlen(tail), len = 0;
+  char **parts = malloc((found > 0 ? found : 1) * sizeof(char *));
+  if (parts == NULL) {
+    free(top);
+    return NULL;
+  }
+  for (int i = 0; i < found; i++) {
+    parts[i] = table ? psr_task_to_row(&top[i], now) : psr_task_to_json_unformatted(&top[i]);
+    if (parts[i] == NULL) {
+      while (i-- > 0) free(parts[i]);
+      free(parts);
+      free(top);
+      return NULL;
+    }
+    cap += strlen(parts[i]) + 1;
+  }
+
+  char *list = malloc(cap + 1);
+  if (list != NULL) {
+    len = sprintf(list, "%s", head);
+    for (int i = 0; i < found; i++) {
+      if (i > 0 || table) list[len++] = table ? '\n' : ',';
+      size_t part_len = strlen(parts[i]);
+      memcpy(list + len, parts[i], part_len);
+      len += part_len;
+    }
+    strcpy(list + len, tail);
+  }
+  for (int i = 0; i < found; i++) free(parts[i]);
+  free(parts);
+  free(top);
+  return list;
+}
+
 static int subcmd_task_del(char *args) {
     // Check if arguments are provided
     if (args == NULL || *args == '\0') {
@@ -189,6 +536,106 @@ static int subcmd_task_del(char *args) {
     return 0;
 }
 
+// What an update job needs once the AI has answered
+typedef struct {
+    int id;
+    time_t created_at;
+    unsigned long long checksum;   // of the record the prompt was built from
+    char instruction[];
+} task_update_ctx_t;
+
+// FNV-1a over the compact JSON of a task, 0 if it can not be serialized
+static unsigned long long task_checksum(const task_t *task) {
+    char *json = psr_task_to_json_unformatted(task);
+    unsigned long long h = 14695981039346656037ull;
+    if (json == NULL) return 0;
+    for (const char *c = json; *c; c ++) h = (h ^ (unsigned char)*c) * 1099511628211ull;
+    free(json);
+    return h;
+}
+
+// 离线队列中保存为 "id created_at checksum instruction"
+static char *save_task_update_ctx(const void *p) {
+    const task_update_ctx_t *ctx = p;
+    size_t len = strlen(ctx->instruction) + 64;
+    char *saved = malloc(len);
+    if (saved == NULL) panic("Memory allocation failed for update job.");
+    snprintf(saved, len, "%d %ld %llx %s", ctx->id, (long)ctx->created_at, ctx->checksum, ctx->instruction);
+    return saved;
+}
+
+static void *load_task_update_ctx(const char *saved) {
+    int id, off = 0;
+    long created_at;
+    unsigned long long checksum;
+    if (sscanf(saved, "%d %ld %llx %n", &id, &created_at, &checksum, &off) != 3 || off == 0 || id <= 0) {
+        return NULL;
+    }
+
+    task_update_ctx_t *ctx = malloc(sizeof(task_update_ctx_t) + strlen(saved + off) + 1);
+    if (ctx == NULL) panic("Memory allocation failed for update job.");
+    ctx->id = id;
+    ctx->created_at = created_at;
+    ctx->checksum = checksum;
+    strcpy(ctx->instruction, saved + off);
+    return ctx;
+}
+
+static int finish_task_update(job_t *job, const char *result) {
+    task_update_ctx_t *ctx = job->ctx;
+    task_t new_task;
+
+    // --- 3. Data Integrity and Parsing (CRITICAL SECTION) ---
+
+    // 3a. Parse the COMPLETE JSON returned by the AI into the new_task structure.
+    if (psr_json_to_task(result, &new_task, 1) != 0) {
+        job_printf(job, "Error: AI returned invalid JSON or ID was missing/invalid.\n");
+        job_printf(job, "Bad JSON from AI: %s\n", result);
+        return -1;
+    }
+
+    // 3b. Crucial check: Ensure AI did not change the ID
+    if (new_task.id != ctx->id) {
+        job_printf(job, "FATAL ERROR: AI returned JSON with changed ID (%d -> %d). Aborting update.\n", ctx->id, new_task.id);
+        return -1;
+    }
+    
+    // 3c. Restore the immutable 'created_at' timestamp, preserved before the call.
+    //     This guarantees data integrity regardless of how psr_json_to_task handled the field.
+    new_task.created_at = ctx->created_at;
+
+    // 3d. The answer rewrites the whole record as it was when the update was
+    //     requested. If the task was edited, completed or deleted since (while
+    //     the request waited in the offline queue, say), it is not applied.
+    task_t current;
+    if (db_find_task_by_id(ctx->id, &current) != 0) {
+        job_printf(job, "Update not applied: task ID %d no longer exists.\n", ctx->id);
+        return -1;
+    }
+    unsigned long long checksum = task_checksum(&current);
+    if (checksum != ctx->checksum) {
+        // A replay after a crash finds its own earlier write
+        if (checksum == task_checksum(&new_task)) {
+            job_printf(job, "Task ID %d already has this update.\n", ctx->id);
+            return 0;
+        }
+        job_printf(job, "Update not applied: task ID %d changed after 'task update %d %s' was requested.\n",
+                   ctx->id, ctx->id, ctx->instruction);
+        return -1;
+    }
+
+    // --- 4. Update Database ---
+    if (db_update_task(&new_task) != 0) {
+        job_printf(job, "Update failed. Database write error for ID %d.\n", ctx->id);
+        return -1;
+    }
+    
+    // Print success logs
+    job_printf(job, "%s\n", result);
+    job_printf(job, "Task ID %d updated successfully based on instruction: '%s'.\n", ctx->id, ctx->instruction);
+    return 0;
+}
+
 static int subcmd_task_update(char *args) {
     // args should look like: "<task_id> <update_instruction>"
     
@@ -220,144 +667,378 @@ static int subcmd_task_update(char *args) {
         return -1;
     }
         
-    old_task_json = psr_task_to_json(&old_task); 
+    // Compact JSON: the indentation of cJSON_Print() only costs tokens
+    old_task_json = psr_task_to_json_unformatted(&old_task);
     if (old_task_json == NULL) {
         Log("Error: Failed to serialize task ID %d to JSON.", id);
         return -1; // Cannot continue without JSON context
     }
 
     // --- 2. Call AI and get the complete modified JSON ---
-    SAFE_FREE(answer);
     
     // Pass old_task.created_at for robust prompt generation (AI knows to preserve it)
     prompt = aic_task_update_prompt(old_task_json, instruction, old_task.created_at); 
+    SAFE_FREE(old_task_json);
     
     if (prompt == NULL) {
         Log("Failed to build update prompt for ID %d", id);
-        SAFE_FREE(old_task_json);
         return -1;
     }
 
-    answer = aic_call(prompt);
+    task_update_ctx_t *ctx = malloc(sizeof(task_update_ctx_t) + strlen(instruction) + 1);
+    if (ctx == NULL) panic("Memory allocation failed for update job.");
+    ctx->id = id;
+    ctx->created_at = old_task.created_at;
+    ctx->checksum = task_checksum(&old_task);
+    strcpy(ctx->instruction, instruction);
 
-    if (answer == NULL) {
-        Log("AI task update error (returned NULL).");
-        SAFE_FREE(old_task_json);
-        free(prompt);
+    if (job_submit(AIC_CMD_TASK_UPDATE, aic_prompt_wrap(prompt), finish_task_update, ctx, NULL) != 0) {
+        Log("AI task update failed for ID %d.", id);
         return -1;
     }
-    
-    // --- 3. Data Integrity and Parsing (CRITICAL SECTION) ---
-
-    // 3a. Preserve immutable data before parsing, in case psr_json_to_task 
-    //     clears the struct or AI's JSON omits the field.
-    time_t preserved_created_at = old_task.created_at; 
-    
-    task_t new_task;
+    return 0;
+}
 
-    // 3b. Parse the COMPLETE JSON returned by the AI into the new_task structure.
-    if (psr_json_to_task(answer, &new_task, 1) != 0) {
-        Log("Error: AI returned invalid JSON or ID was missing/invalid.");
-        Log("Bad JSON from AI: %s\n", answer); 
-        SAFE_FREE(answer);
-        SAFE_FREE(old_task_json);
-        free(prompt);
-        return -1;
-    }
+static int subcmd_task_export(char *args) {
+  char *path = strtok(NULL, " ");
+  if (path == NULL) {
+    _Log("Usage: task export <file>\n");
+    return -1;
+  }
 
-    // 3c. Crucial check: Ensure AI did not change the ID
-    if (new_task.id != id) {
-        _Log("FATAL ERROR: AI returned JSON with changed ID (%d -> %d). Aborting update.\n", id, new_task.id);
-        SAFE_FREE(answer);
-        SAFE_FREE(old_task_json);
-        free(prompt);
-        return -1;
-    }
-    
-    // 3d. Restore the immutable 'created_at' timestamp. 
-    //     This guarantees data integrity regardless of how psr_json_to_task handled the field.
-    new_task.created_at = preserved_created_at;
+  int exported = db_export_ndjson(path);
+  if (exported < 0) {
+    _Log("Error: Failed to export tasks to '%s'.\n", path);
+    return -1;
+  }
+  _Log("Success: %d tasks exported to '%s'.\n", exported, path);
+  return 0;
+}
 
-    // --- 4. Update Database and Cleanup ---
-    if (db_update_task(&new_task) != 0) {
-        Log("Update failed. Database write error for ID %d.\n", id);
-        SAFE_FREE(answer);
-        SAFE_FREE(old_task_json);
-        free(prompt);
-        return -1;
-    }
-    
-    // Print success logs
-    Log("%s", answer);
-    Log("Task ID %d updated successfully based on instruction: '%s'.", id, instruction);
+static int subcmd_task_import(char *args) {
+  char *path = strtok(NULL, " ");
+  if (path == NULL) {
+    _Log("Usage: task import <file>\n");
+    return -1;
+  }
 
-    SAFE_FREE(answer);
-    SAFE_FREE(old_task_json);
-    free(prompt);
-    return 0;
+  int imported = db_import_ndjson(path);
+  if (imported < 0) {
+    _Log("Error: Failed to import tasks from '%s'.\n", path);
+    return -1;
+  }
+  _Log("Success: %d tasks imported from '%s'.\n", imported, path);
+  return 0;
 }
 
 static int cmd_ai(char *args) {
   return cmd_dispatch(subcmd_ai_table, NR_SUBCMD(ai), args);
 }
 
+// Prints answer text as it streams in
+static void print_token(const char *token, size_t len, void *userp) {
+  _Log("%.*s", (int)len, token);
+  fflush(stdout);
+}
+
+// Shows a text answer; in the foreground it has already been streamed.
+// ctx is an optional heading.
+static int finish_ai_text(job_t *job, const char *result) {
+  if (job->background) {
+    if (job->ctx) job_printf(job, "%s", (char *)job->ctx);
+    job_printf(job, "%s\n", result);
+  } else {
+    job_printf(job, "\n");
+  }
+  return 0;
+}
+
+// Runs a free-text AI command, streaming the answer when in the foreground
+static int run_ai_text(aic_cmd_e cmd, aic_prompt_t *prompt, const char *heading) {
+  char *ctx = NULL;
+
+  if (jobs_in_background()) {
+    if (heading) ctx = strdup(heading);
+  } else if (heading) {
+    _Log("%s", heading);
+  }
+  return job_submit(cmd, prompt, finish_ai_text, ctx, print_token);
+}
+
+// The chat session; only touched with the db lock held, like the database
+static aic_chat_t *chat = NULL;
+
+typedef struct {
+  size_t estimated;     // prompt tokens, estimated locally
+  char input[];
+} chat_ctx_t;
+
+// Adds the answered turn to the chat memory and reports what it cost
+static int finish_ai_chat(job_t *job, const char *result) {
+  chat_ctx_t *ctx = job->ctx;
+  const aic_timing_t *t = &job->timing;
+  aic_chat_stats_t st;
+
+  aic_chat_commit(chat, ctx->input, result);
+  aic_chat_get_stats(chat, &st);
+
+  if (job->background) job_printf(job, "%s\n", result);
+  else job_printf(job, "\n");
+  if (t->prompt_tokens > 0) {
+    job_printf(job, "(prompt %ld tokens, %ld cached", t->prompt_tokens, t->cached_tokens);
+  } else {
+    job_printf(job, "(prompt ~%zu tokens", ctx->estimated);
+  }
+  job_printf(job, "; history %zu/%zu tokens, %d turns%s; %.1f ms)\n", st.history_tokens,
+      aic_get_token_budget(AIC_CMD_CHAT), st.turns, aic_chat_summary(chat) ? " + summary" : "",
+      t->total_us / 1000.0);
+  return 0;
+}
+
 static int subcmd_ai_chat(char *args) {
-  SAFE_FREE(answer);
+  if (args == NULL || *args == '\0') {
+    _Log("Usage: ai chat <message>\n");
+    return -1;
+  }
+
+  // Each message is sent after the previous answer; two chats in the
+  // background would both be built from the history without the other
+  if (jobs_in_background()) {
+    _Log("ai chat runs in the foreground: each message builds on the previous answer.\n");
+    jobs_set_background(NULL);
+  }
+
+  if (chat == NULL) chat = aic_chat_new();
+  aic_prompt_t *prompt = aic_chat_prompt(chat, args);
+  chat_ctx_t *ctx = malloc(sizeof(chat_ctx_t) + strlen(args) + 1);
+  if (prompt == NULL || ctx == NULL) panic("Memory allocation failed for chat prompt.");
+  ctx->estimated = aic_prompt_tokens(prompt);
+  strcpy(ctx->input, args);
 
-  answer = aic_call(args);
-  if (answer == NULL) {
+  if (job_submit(AIC_CMD_CHAT, prompt, finish_ai_chat, ctx, print_token) != 0) {
     Log("AI chat error");
     return -1;
   }
-  _Log("%s\n", answer);
+  return 0;
+}
+
+static int subcmd_ai_history(char *args) {
+  aic_chat_stats_t st;
+  const char *user, *answer;
+
+  if (chat == NULL) {
+    _Log("Nothing said yet.\n");
+    return 0;
+  }
+  aic_chat_get_stats(chat, &st);
+  _Log("History : %zu of %zu tokens, %d turns kept, %d compactions\n", st.history_tokens,
+      aic_get_token_budget(AIC_CMD_CHAT), st.turns, st.compactions);
+  if (aic_chat_summary(chat)) {
+    _Log("\n--- Summary (%zu tokens) ---\n%s\n", st.summary_tokens, aic_chat_summary(chat));
+  }
+  for (int i = 0; aic_chat_turn(chat, i, &user, &answer) == 0; i ++) {
+    _Log("\n> %s\n%s\n", user, answer);
+  }
+  return 0;
+}
 
-  SAFE_FREE(answer);
+static int subcmd_ai_forget(char *args) {
+  if (chat) aic_chat_forget(chat);
+  _Log("Chat memory cleared.\n");
   return 0;
 }
 
 static int subcmd_ai_sug(char *args) {
-  // args is currently unused for task suggestion, but included for completeness.
-  
-  char *task_list_json = NULL;
-  char *prompt = NULL;
-
-  // This calls the function implemented in the database layer.
-  task_list_json = db_get_all_tasks_json(); 
+  char *task_list = NULL;
+  aic_prompt_t *prompt = NULL;
+  char *arg = strtok(NULL, " ");
+  db_format_e format = aic_template_format(AIC_CMD_SUGGEST) == AIC_FORMAT_TABLE ?
+      DB_FORMAT_TABLE : DB_FORMAT_JSON;
+  int nr_included = 0, nr_total = 0;
+
+  if (arg != NULL) {
+    // Only the locally pre-ranked candidates; the AI picks and justifies
+    int k = atoi(arg);
+    if (k <= 0) {
+      _Log("Usage: ai sug [K]\n");
+      return -1;
+    }
+    task_list = top_tasks_list(k, format, time(NULL), &nr_included);
+    nr_total = nr_included;
+  } else {
+    // The whole list, cut down to the most relevant tasks if it exceeds the budget
+    size_t budget = aic_data_budget(AIC_CMD_SUGGEST);
+    task_list = db_get_task_list_within(format, time(NULL), budget, aic_estimate_tokens,
+        &nr_included, &nr_total);
+    if (nr_included < nr_total) {
+      _Log("INFO: Sending the %d most relevant of %d tasks (budget %zu tokens).\n",
+          nr_included, nr_total, aic_get_token_budget(AIC_CMD_SUGGEST));
+    }
+  }
 
-  if (task_list_json == NULL || strcmp(task_list_json, "[]") == 0) {
+  if (task_list == NULL || nr_total == 0) {
     _Log("INFO: No active tasks found. Nothing to suggest.\n");
-    // If task_list_json is "[]" (empty array), we should free it.
-    SAFE_FREE(task_list_json); 
+    SAFE_FREE(task_list);
     return 0; // Success, but nothing to do
   }
 
-  SAFE_FREE(answer);
-  
-  prompt = aic_task_suggest_prompt(task_list_json);
-  
+  // The task list is handed over, not copied into the prompt
+  prompt = aic_task_suggest_prompt(task_list);
+
   if (prompt == NULL) {
     Log("Failed to build suggestion prompt.");
-    SAFE_FREE(task_list_json);
     return -1;
   }
 
   _Log("INFO: Asking AI for next task suggestion...\n");
-  answer = aic_call(prompt);
-
-  if (answer == NULL) {
+  if (run_ai_text(AIC_CMD_SUGGEST, prompt, "\n=== AI Suggested Next Task ===\n") != 0) {
     Log("AI suggestion error (returned NULL).");
-    SAFE_FREE(prompt);
-    SAFE_FREE(task_list_json);
     return -1;
   }
-  
-  Log("\n=== AI Suggested Next Task ===\n%s\n", answer);
+  return 0;
+}
+
+static int subcmd_ai_timing(char *args) {
+  aic_timing_t t;
+  aic_get_last_timing(&t);
 
-  // Clean up dynamically allocated memory
-  SAFE_FREE(answer);
-  SAFE_FREE(prompt);
-  SAFE_FREE(task_list_json);
-  
+  _Log("DNS     : %8.1f ms\n", t.dns_us / 1000.0);
+  _Log("Connect : %8.1f ms\n", t.connect_us / 1000.0);
+  _Log("TLS     : %8.1f ms\n", t.tls_us / 1000.0);
+  _Log("TTFB    : %8.1f ms\n", t.ttfb_us / 1000.0);
+  _Log("TTFT    : %8.1f ms\n", t.ttft_us / 1000.0);
+  _Log("Total   : %8.1f ms%s\n", t.total_us / 1000.0, t.reused ? " (reused connection)" : "");
+  return 0;
+}
+
+static int subcmd_ai_cache(char *args) {
+  aic_cache_stats_t s;
+  aic_get_cache_stats(&s);
+
+  uint64_t lookups = s.hits + s.misses;
+  _Log("Hits      : %" PRIu64 " (%.1f%%)\n", s.hits, lookups ? 100.0 * s.hits / lookups : 0.0);
+  _Log("Misses    : %" PRIu64 "\n", s.misses);
+  _Log("Stores    : %" PRIu64 "\n", s.stores);
+  _Log("Evictions : %" PRIu64 "\n", s.evictions);
+  _Log("Entries   : %d (%zu bytes)\n", s.entries, s.bytes);
+  return 0;
+}
+
+static int subcmd_ai_latency(char *args) {
+  _Log("%-12s %6s %9s %9s %9s %9s %6s %6s %9s %7s\n", "command", "n", "p50 ms", "p95 ms",
+      "p99 ms", "1st p95", "fail", "retry", "hedge/won", "shared");
+  for (int cmd = 0; cmd < NR_AIC_CMD; cmd ++) {
+    aic_latency_t l;
+    aic_get_latency(cmd, &l);
+    if (l.requests == 0 && l.coalesced == 0) continue;
+    _Log("%-12s %6d %9.1f %9.1f %9.1f %9.1f %6" PRIu64 " %6" PRIu64 " %4" PRIu64 "/%-4" PRIu64 " %7" PRIu64 "\n",
+        aic_cmd_name(cmd), l.samples, l.p50_us / 1000.0, l.p95_us / 1000.0, l.p99_us / 1000.0,
+        l.first_p95_us / 1000.0, l.failures, l.retries, l.hedges, l.hedge_wins, l.coalesced);
+  }
+  return 0;
+}
+
+static int subcmd_ai_tokens(char *args) {
+  _Log("%-12s %7s %6s %10s %10s %7s %10s\n", "command", "budget", "n", "estimated",
+      "prompt", "error", "completion");
+  for (int cmd = 0; cmd < NR_AIC_CMD; cmd ++) {
+    aic_token_stats_t t;
+    aic_get_token_stats(cmd, &t);
+    size_t budget = aic_get_token_budget(cmd);
+    if (t.requests == 0 && budget == 0) continue;
+
+    char budget_str[16];
+    if (budget > 0) snprintf(budget_str, sizeof(budget_str), "%zu", budget);
+    else snprintf(budget_str, sizeof(budget_str), "-");
+    double error = t.prompt_tokens ? 100.0 * ((double)t.estimated - t.prompt_tokens) / t.prompt_tokens : 0.0;
+    _Log("%-12s %7s %6" PRIu64 " %10" PRIu64 " %10" PRIu64 " %+6.1f%% %10" PRIu64 "\n",
+        aic_cmd_name(cmd), budget_str, t.requests, t.estimated, t.prompt_tokens, error,
+        t.completion_tokens);
+  }
+
+  // Prefix cache: share of prompt tokens the server did not have to process,
+  // and the time to first byte with and without a hit
+  _Log("\n%-12s %10s %10s %7s %8s %12s %12s\n", "command", "cache hit", "miss", "hit%",
+      "cached n", "1st hit ms", "1st miss ms");
+  for (int cmd = 0; cmd < NR_AIC_CMD; cmd ++) {
+    aic_token_stats_t t;
+    aic_get_token_stats(cmd, &t);
+    if (t.requests == 0) continue;
+
+    uint64_t cached = t.cache_hit_tokens + t.cache_miss_tokens;
+    uint64_t uncached_n = t.requests - t.cached_requests;
+    _Log("%-12s %10" PRIu64 " %10" PRIu64 " %6.1f%% %8" PRIu64 " %12.1f %12.1f\n",
+        aic_cmd_name(cmd), t.cache_hit_tokens, t.cache_miss_tokens,
+        cached ? 100.0 * t.cache_hit_tokens / cached : 0.0, t.cached_requests,
+        t.cached_requests ? t.cached_first_byte_us / 1000.0 / t.cached_requests : 0.0,
+        uncached_n ? t.uncached_first_byte_us / 1000.0 / uncached_n : 0.0);
+  }
+  return 0;
+}
+
+static int subcmd_ai_routes(char *args) {
+  _Log("%-12s %-20s %6s %5s %4s %8s %6s %9s %9s %10s %6s  %s\n", "command", "model", "max", "temp",
+      "json", "timeout", "n", "p50 ms", "p95 ms", "completion", "fail", "url");
+  for (int cmd = 0; cmd < NR_AIC_CMD; cmd ++) {
+    aic_route_info_t r;
+    aic_latency_t l;
+    aic_token_stats_t t;
+    aic_get_route(cmd, &r);
+    aic_get_latency(cmd, &l);
+    aic_get_token_stats(cmd, &t);
+
+    char max[24] = "-", temp[16] = "-";
+    if (r.max_tokens > 0) snprintf(max, sizeof(max), "%ld", r.max_tokens);
+    if (r.temperature >= 0) snprintf(temp, sizeof(temp), "%.2g", r.temperature);
+    // Mean completion tokens: what max_tokens has to leave room for
+    _Log("%-12s %-20s %6s %5s %4s %7lds %6d %9.1f %9.1f %10.0f %6" PRIu64 "  %s\n",
+        aic_cmd_name(cmd), r.model, max, temp, r.json_mode ? "on" : "-", r.timeout_ms / 1000, l.samples,
+        l.p50_us / 1000.0, l.p95_us / 1000.0,
+        t.requests ? (double)t.completion_tokens / t.requests : 0.0, l.failures, r.url);
+  }
+  return 0;
+}
+
+static int subcmd_ai_json(char *args) {
+  _Log("%-12s %7s %7s %9s %11s %9s %6s %8s\n", "command", "answers", "clean", "extracted",
+      "corrections", "corrected", "failed", "retry%");
+  for (int cmd = 0; cmd < NR_AIC_CMD; cmd ++) {
+    aic_json_stats_t j;
+    aic_get_json_stats(cmd, &j);
+    if (j.answers == 0) continue;
+    _Log("%-12s %7" PRIu64 " %7" PRIu64 " %9" PRIu64 " %11" PRIu64 " %9" PRIu64 " %6" PRIu64 " %7.1f%%\n",
+        aic_cmd_name(cmd), j.answers, j.clean, j.extracted, j.corrections, j.corrected, j.failed,
+        100.0 * j.corrections / j.answers);
+  }
+  return 0;
+}
+
+static int subcmd_ai_queue(char *args) {
+  char *arg = strtok(NULL, " ");
+  if (arg != NULL && strcmp(arg, "retry") == 0) {
+    queue_retry();
+    _Log("Retrying queued AI requests now.\n");
+    return 0;
+  }
+  queue_list();
+  return 0;
+}
+
+static int subcmd_ai_local(char *args) {
+  aic_local_stats_t s;
+  aic_get_local_stats(&s);
+
+  uint64_t adds = s.local + s.fallback;
+  _Log("Local     : %" PRIu64 " of %" PRIu64 " task adds (%.1f%%)\n", s.local, adds,
+      adds ? 100.0 * s.local / adds : 0.0);
+  _Log("Parse     : %8.3f ms avg locally\n", s.local ? s.local_us / 1000.0 / s.local : 0.0);
+  if (s.remote == 0) {
+    _Log("AI        : no round trips measured yet\n");
+    return 0;
+  }
+  double remote_ms = s.remote_us / 1000.0 / s.remote;
+  _Log("AI        : %8.1f ms avg over %" PRIu64 " round trips\n", remote_ms, s.remote);
+  _Log("Saved     : %8.1f ms\n", s.local * remote_ms - s.local_us / 1000.0);
   return 0;
 }
 
@@ -365,53 +1046,159 @@ static int cmd_report(char *args) {
   return cmd_dispatch(subcmd_report_table, ARRLEN(subcmd_report_table), args);
 }
 
-static int generate_report(const char *report_type) {
-    char *task_list_json = db_get_all_tasks_json(); 
+static int generate_report(const char *report_type, int window_days) {
+    db_report_t report;
 
-    if (task_list_json == NULL || strcmp(task_list_json, "[]") == 0) {
+    if (db_build_report(time(NULL), window_days, &report) != 0) {
+        Log("Failed to aggregate %s report data.", report_type);
+        return -1;
+    }
+    if (report.total == 0) {
         _Log("INFO: No tasks to generate %s report.\n", report_type);
-        SAFE_FREE(task_list_json); 
         return 0;
     }
-    
-    SAFE_FREE(answer);
-    char *prompt = aic_report_prompt(task_list_json, report_type); 
-    
+
+    // Encoded as the template expects; over budget, drop the least relevant
+    // entry of the longest task list until it fits
+    char *(*encode)(const db_report_t *, const char *) =
+        aic_template_format(AIC_CMD_REPORT) == AIC_FORMAT_TABLE ? psr_report_to_table : psr_report_to_json;
+    size_t budget = aic_data_budget(AIC_CMD_REPORT);
+    char *report_data = encode(&report, report_type);
+    while (report_data != NULL && budget > 0 &&
+           aic_estimate_tokens(report_data, strlen(report_data)) > budget) {
+        int *longest = &report.nr_completed_list;
+        if (report.nr_critical_list > *longest) longest = &report.nr_critical_list;
+        if (report.nr_overdue_list > *longest) longest = &report.nr_overdue_list;
+        if (*longest == 0) break;
+        (*longest)--;
+        SAFE_FREE(report_data);
+        report_data = encode(&report, report_type);
+    }
+    if (report_data == NULL) {
+        Log("Failed to serialize %s report data.", report_type);
+        return -1;
+    }
+
+    aic_prompt_t *prompt = aic_report_prompt(report_data, report_type);
+
     if (prompt == NULL) {
         Log("Failed to build %s report prompt.", report_type);
-        SAFE_FREE(task_list_json);
         return -1;
     }
 
+    char heading[64];
+    snprintf(heading, sizeof(heading), "\n=== %s Report ===\n", report_type);
     _Log("INFO: Generating %s report...\n", report_type);
-    answer = aic_call(prompt);
-
-    if (answer == NULL) {
+    if (run_ai_text(AIC_CMD_REPORT, prompt, heading) != 0) {
         Log("AI report generation error for %s.", report_type);
-        SAFE_FREE(prompt);
-        SAFE_FREE(task_list_json);
         return -1;
     }
-    
-    _Log("\n=== %s Report ===\n%s\n", report_type, answer);
-
-    SAFE_FREE(answer);
-    SAFE_FREE(prompt);
-    SAFE_FREE(task_list_json);
     return 0;
 }
 
 static int subcmd_report_w(char *args) {
-  return generate_report("WEEKLY");
+  return generate_report("WEEKLY", 7);
 }
 
 static int subcmd_report_m(char *args) {
-  return generate_report("MONTHLY");
+  return generate_report("MONTHLY", 30);
+}
+
+static int cmd_bench(char *args) {
+  return cmd_dispatch(subcmd_bench_table, NR_SUBCMD(bench), args);
+}
+
+static uint64_t get_time_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int subcmd_bench_json(char *args) {
+  char *arg = strtok(NULL, " ");
+  int max_threads = arg ? atoi(arg) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  arg = strtok(NULL, " ");
+  int rounds = arg ? atoi(arg) : 100;
+
+  if (max_threads <= 0 || rounds <= 0) {
+    _Log("Usage: bench json [max_threads] [rounds]\n");
+    return -1;
+  }
+
+  _Log("Serializing %d tasks, %d cold rounds per thread count\n", db_get_task_count(), rounds);
+  uint64_t base_us = 0;
+  for (int nr_threads = 1; nr_threads <= max_threads; nr_threads ++) {
+    uint64_t total_us = 0;
+    for (int i = 0; i < rounds; i ++) {
+      db_drop_json_cache();
+      uint64_t start = get_time_us();
+      char *json = db_get_all_tasks_json_parallel(nr_threads);
+      total_us += get_time_us() - start;
+      if (json == NULL) {
+        Log("Serialization failed with %d threads", nr_threads);
+        return -1;
+      }
+      free(json);
+    }
+    if (nr_threads == 1) base_us = total_us;
+    _Log("threads=%-3d avg=%8.1f us  speedup=%.2fx\n", nr_threads,
+        (double)total_us / rounds, total_us ? (double)base_us / total_us : 0.0);
+  }
+
+  // Warm cache: what repeated report generation actually pays
+  uint64_t start = get_time_us();
+  for (int i = 0; i < rounds; i ++) { free(db_get_all_tasks_json()); }
+  _Log("cached     avg=%8.1f us\n", (double)(get_time_us() - start) / rounds);
+  return 0;
+}
+
+// One line of 'bench prompt'; base is the tokens of the encoding compared against
+static size_t bench_prompt_line(const char *what, char *data, size_t base) {
+  if (data == NULL) return 0;
+  size_t len = strlen(data);
+  size_t tokens = aic_estimate_tokens(data, len);
+  _Log("%-22s %10zu %10zu", what, len, tokens);
+  if (base > 0) _Log("  %+6.1f%%", 100.0 * ((double)tokens - base) / base);
+  _Log("\n");
+  free(data);
+  return tokens;
+}
+
+static int subcmd_bench_prompt(char *args) {
+  time_t now = time(NULL);
+  db_report_t report;
+  task_t task;
+
+  _Log("%-22s %10s %10s\n", "encoding", "bytes", "est.tokens");
+  size_t base = bench_prompt_line("task list, JSON",
+      db_get_task_list_within(DB_FORMAT_JSON, now, 0, NULL, NULL, NULL), 0);
+  bench_prompt_line("task list, table",
+      db_get_task_list_within(DB_FORMAT_TABLE, now, 0, NULL, NULL, NULL), base);
+
+  if (db_build_report(now, 7, &report) == 0) {
+    base = bench_prompt_line("weekly report, JSON", psr_report_to_json(&report, "WEEKLY"), 0);
+    bench_prompt_line("weekly report, table", psr_report_to_table(&report, "WEEKLY"), base);
+  }
+
+  if (db_next_tasks(1, &task) == 1) {
+    base = bench_prompt_line("one task, cJSON_Print", psr_task_to_json(&task), 0);
+    bench_prompt_line("one task, compact JSON", psr_task_to_json_unformatted(&task), base);
+    bench_prompt_line("one task, table row", psr_task_to_row(&task, now), base);
+  }
+  return 0;
 }
 
 void adb_mainloop() {
   for (char *str; (str = rl_gets()) != NULL; ) {
+    // A trailing '&' sends the command's AI request to the background
     char *str_end = str + strlen(str);
+    while (str_end > str && str_end[-1] == ' ') *--str_end = '\0';
+    if (str_end > str && str_end[-1] == '&') {
+      *--str_end = '\0';
+      while (str_end > str && str_end[-1] == ' ') *--str_end = '\0';
+      jobs_set_background(str);
+    }
+    jobs_set_command(str);
 
     /* extract the first token as the command */
     char *cmd = strtok(str, " ");
@@ -425,14 +1212,19 @@ void adb_mainloop() {
       args = NULL;
     }
 
-    int i;
+    int i, ret = 0;
+    jobs_lock_db();
     for (i = 0; i < NR_CMD; i ++) {
       if (strcmp(cmd, cmd_table[i].name) == 0) {
-        if (cmd_table[i].handler(args) < 0) { return; }
+        ret = cmd_table[i].handler(args);
         break;
       }
     }
+    jobs_unlock_db();
+    jobs_set_background(NULL);
+    jobs_set_command(NULL);
 
+    if (ret < 0) { return; }
     if (i == NR_CMD) { _Log("Unknown command '%s'\n", cmd); }
   }
 }
@@ -440,4 +1232,20 @@ void adb_mainloop() {
 void adb_init() {
   /* Compile the regular expressions. */
   init_regex();
+
+  jobs_init(ADB_JOB_WORKERS);
+  rl_event_hook = job_event_hook;
+
+  // Commands whose input is kept while the endpoint is unreachable
+  queue_register(AIC_CMD_TASK_ADD, &(queue_handler_t){ finish_task_add, NULL, NULL });
+  queue_register(AIC_CMD_TASK_MULTI, &(queue_handler_t){ finish_task_multi, NULL, NULL });
+  queue_register(AIC_CMD_TASK_UPDATE,
+      &(queue_handler_t){ finish_task_update, save_task_update_ctx, load_task_update_ctx });
+}
+
+void adb_cleanup() {
+  queue_stop();
+  jobs_shutdown();
+  aic_chat_free(chat);
+  chat = NULL;
 }
\ No newline at end of file
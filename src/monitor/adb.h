@@ -12,4 +12,67 @@ typedef struct {
 void init_regex();
 word_t expr(char *e, bool *success);
 
+// --- AI jobs (jobs.c) ---
+
+#include "ai_client.h"
+
+#define ADB_JOB_WORKERS 2
+
+typedef enum { JOB_QUEUED, JOB_RUNNING, JOB_DONE, JOB_FAILED } job_state_e;
+
+typedef struct job job_t;
+
+// Commits an answer (db writes allowed); returns 0 on success
+typedef int (*job_finish_t)(job_t *job, const char *answer);
+
+struct job {
+  int id;
+  char *title;          // command line as typed
+  aic_cmd_e cmd;
+  aic_prompt_t *prompt;
+  job_finish_t finish;
+  void *ctx;            // finish-specific data, freed with the job
+  bool background;
+  time_t queued_at;     // replay of an offline request queued then, 0 otherwise
+  job_state_e state;
+  aic_timing_t timing;  // of the request, set before finish runs
+  MemoryStruct_t out;   // output of a background job, shown on completion
+  job_t *next;
+};
+
+void jobs_init(int nr_workers);
+void jobs_shutdown();
+void jobs_set_command(const char *line);
+void jobs_set_background(const char *title);
+bool jobs_in_background();
+int  job_submit(aic_cmd_e cmd, aic_prompt_t *prompt, job_finish_t finish, void *ctx,
+    aic_token_cb on_token);
+void job_printf(job_t *job, const char *fmt, ...);
+bool jobs_have_news();
+void jobs_report();
+void jobs_list();
+int  jobs_wait(int id);
+void jobs_adopt(job_t *job, job_state_e state);
+void jobs_lock_db();
+void jobs_unlock_db();
+
+// --- Offline queue (queue.c) ---
+
+// How to commit a queued command and carry its finish data across restarts
+typedef struct {
+  job_finish_t finish;
+  char *(*save_ctx)(const void *ctx);   // NULL if the command has no ctx
+  void *(*load_ctx)(const char *saved); // returns NULL if saved is unreadable
+} queue_handler_t;
+
+void queue_register(aic_cmd_e cmd, const queue_handler_t *handler);
+int  queue_open(const char *path);
+bool queue_accepts(aic_cmd_e cmd);
+bool queue_offline();
+int  queue_push(const job_t *job);
+void queue_list();
+void queue_retry();
+void queue_stop();
+void queue_close();
+
 #endif
@@ -0,0 +1,317 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include "adb.h"
+
+// Background AI jobs.
+// A command line ending in '&' turns its AI request into a job: the prompt is
+// built on the REPL thread, the HTTP round trip runs on a worker, and the
+// answer is committed by the worker under the database lock. Finished jobs
+// are reported by the REPL between keystrokes.
+
+static job_t *job_list = NULL;      // all unreported jobs, in submission order
+static int next_job_id = 1;
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_cond = PTHREAD_COND_INITIALIZER;
+
+// Held by the REPL while a command runs and by workers while committing
+static pthread_mutex_t db_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t workers[ADB_JOB_WORKERS];
+static int nr_workers = 0;
+static bool stopping = false;
+
+// Title of the next job, set when the current command line ends in '&'
+static char *pending_title = NULL;
+
+// Command line being run, kept as the title of a request that gets queued
+static char *command_line = NULL;
+
+static const char *state_name[] = {
+  [JOB_QUEUED]  = "Queued",
+  [JOB_RUNNING] = "Running",
+  [JOB_DONE]    = "Done",
+  [JOB_FAILED]  = "Failed",
+};
+
+static void job_free(job_t *job) {
+  free(job->title);
+  aic_prompt_free(job->prompt);
+  free(job->ctx);
+  free(job->out.memory);
+  free(job);
+}
+
+static job_t *job_find(int id) {
+  for (job_t *job = job_list; job; job = job->next) {
+    if (job->id == id) return job;
+  }
+  return NULL;
+}
+
+static bool job_finished(const job_t *job) {
+  return job->state == JOB_DONE || job->state == JOB_FAILED;
+}
+
+static bool jobs_all_finished() {
+  for (job_t *job = job_list; job; job = job->next) {
+    if (!job_finished(job)) return false;
+  }
+  return true;
+}
+
+// Hands the request to the offline queue, which commits it later
+static int job_enqueue(job_t *job) {
+  int seq = queue_push(job);
+  if (seq < 0) {
+    job_printf(job, "AI request failed.\n");
+    return -1;
+  }
+  job_printf(job, "AI endpoint unreachable, queued as #%d; it is committed once the endpoint "
+      "is back (see 'ai queue').\n", seq);
+  return 0;
+}
+
+// Calls the AI and commits the answer; db_lock must NOT be held by the caller
+static int job_execute(job_t *job, aic_token_cb on_token) {
+  // While the queue is waiting for the endpoint, don't wait for it here too
+  if (queue_accepts(job->cmd) && queue_offline()) return job_enqueue(job);
+
+  char *result = aic_call_prompt(job->cmd, job->prompt, on_token, NULL);
+  int ret = -1;
+  aic_get_call_timing(&job->timing);
+
+  if (result == NULL && aic_last_error() == AIC_ERR_NETWORK && queue_accepts(job->cmd)) {
+    return job_enqueue(job);
+  }
+
+  jobs_lock_db();
+  if (result == NULL) {
+    job_printf(job, "AI request failed.\n");
+  } else {
+    ret = job->finish(job, result);
+  }
+  jobs_unlock_db();
+
+  free(result);
+  return ret;
+}
+
+static void *job_worker(void *arg) {
+  pthread_mutex_lock(&jobs_lock);
+  for (;;) {
+    job_t *job = NULL;
+    for (job_t *j = job_list; j; j = j->next) {
+      if (j->state == JOB_QUEUED) { job = j; break; }
+    }
+    if (job == NULL) {
+      if (stopping) break;
+      pthread_cond_wait(&jobs_cond, &jobs_lock);
+      continue;
+    }
+
+    job->state = JOB_RUNNING;
+    pthread_mutex_unlock(&jobs_lock);
+
+    int ret = job_execute(job, NULL);
+
+    pthread_mutex_lock(&jobs_lock);
+    job->state = (ret == 0 ? JOB_DONE : JOB_FAILED);
+    pthread_cond_broadcast(&jobs_cond);
+  }
+  pthread_mutex_unlock(&jobs_lock);
+  return NULL;
+}
+
+void jobs_init(int nr) {
+  if (nr > ADB_JOB_WORKERS) nr = ADB_JOB_WORKERS;
+  for (nr_workers = 0; nr_workers < nr; nr_workers ++) {
+    if (pthread_create(&workers[nr_workers], NULL, job_worker, NULL) != 0) {
+      Log("Failed to start job worker, background jobs run on %d threads.", nr_workers);
+      break;
+    }
+  }
+}
+
+void jobs_shutdown() {
+  pthread_mutex_lock(&jobs_lock);
+  if (!jobs_all_finished()) {
+    _Log("INFO: Waiting for background jobs to finish...\n");
+  }
+  stopping = true;
+  pthread_cond_broadcast(&jobs_cond);
+  pthread_mutex_unlock(&jobs_lock);
+
+  for (int i = 0; i < nr_workers; i ++) pthread_join(workers[i], NULL);
+  nr_workers = 0;
+  jobs_report();
+}
+
+void jobs_set_command(const char *line) {
+  SAFE_FREE(command_line);
+  if (line) command_line = strdup(line);
+}
+
+void jobs_set_background(const char *title) {
+  SAFE_FREE(pending_title);
+  if (title) pending_title = strdup(title);
+}
+
+// Whether the command being run was asked to go to the background
+bool jobs_in_background() {
+  return pending_title != NULL && nr_workers > 0;
+}
+
+void jobs_lock_db() {
+  pthread_mutex_lock(&db_lock);
+}
+
+void jobs_unlock_db() {
+  pthread_mutex_unlock(&db_lock);
+}
+
+void job_printf(job_t *job, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf(NULL, 0, fmt, ap);
+  va_end(ap);
+  if (len < 0) return;
+
+  char *buf = malloc(len + 1);
+  if (!buf) panic("Memory allocation failed for job output.");
+  va_start(ap, fmt);
+  vsnprintf(buf, len + 1, fmt, ap);
+  va_end(ap);
+
+  if (!job->background) {
+    _Log("%s", buf);
+    free(buf);
+    return;
+  }
+
+  MemoryStruct_t *out = &job->out;
+  char *p = realloc(out->memory, out->size + len + 1);
+  if (!p) panic("Memory allocation failed for job output.");
+  memcpy(p + out->size, buf, len + 1);
+  out->memory = p;
+  out->size += len;
+  free(buf);
+}
+
+/**
+ * Runs an AI request for the current command. Must be called from the REPL
+ * thread with the db lock held. In the foreground the answer is committed
+ * before returning; in the background this only queues the job.
+ * Takes ownership of prompt and ctx.
+ */
+int job_submit(aic_cmd_e cmd, aic_prompt_t *prompt, job_finish_t finish, void *ctx,
+    aic_token_cb on_token) {
+  job_t *job = calloc(1, sizeof(job_t));
+  if (!job) panic("Memory allocation failed for job.");
+  job->cmd = cmd;
+  job->prompt = prompt;
+  job->finish = finish;
+  job->ctx = ctx;
+
+  if (!jobs_in_background()) {
+    if (command_line) job->title = strdup(command_line);
+    // Let background jobs commit while this request is on the wire
+    jobs_unlock_db();
+    int ret = job_execute(job, on_token);
+    jobs_lock_db();
+    job_free(job);
+    return ret;
+  }
+
+  job->background = true;
+  job->title = pending_title;
+  pending_title = NULL;
+  job->state = JOB_QUEUED;
+
+  pthread_mutex_lock(&jobs_lock);
+  job->id = next_job_id ++;
+  job_t **tail = &job_list;
+  while (*tail) tail = &(*tail)->next;
+  *tail = job;
+  pthread_cond_signal(&jobs_cond);
+  pthread_mutex_unlock(&jobs_lock);
+
+  _Log("[%d] %s\n", job->id, job->title);
+  return 0;
+}
+
+/**
+ * Adds a job that was run elsewhere (a replayed offline request) to the list,
+ * so it is reported like the others. Takes ownership of job.
+ */
+void jobs_adopt(job_t *job, job_state_e state) {
+  pthread_mutex_lock(&jobs_lock);
+  job->id = next_job_id ++;
+  job->state = state;
+  job_t **tail = &job_list;
+  while (*tail) tail = &(*tail)->next;
+  *tail = job;
+  pthread_cond_broadcast(&jobs_cond);
+  pthread_mutex_unlock(&jobs_lock);
+}
+
+bool jobs_have_news() {
+  bool news = false;
+  pthread_mutex_lock(&jobs_lock);
+  for (job_t *job = job_list; job; job = job->next) {
+    if (job_finished(job)) { news = true; break; }
+  }
+  pthread_mutex_unlock(&jobs_lock);
+  return news;
+}
+
+// Prints and forgets every finished job
+void jobs_report() {
+  pthread_mutex_lock(&jobs_lock);
+  for (job_t **p = &job_list; *p; ) {
+    job_t *job = *p;
+    if (!job_finished(job)) { p = &job->next; continue; }
+
+    _Log("[%d] %-7s %s\n", job->id, state_name[job->state], job->title);
+    if (job->out.memory) _Log("%s", job->out.memory);
+    *p = job->next;
+    job_free(job);
+  }
+  pthread_mutex_unlock(&jobs_lock);
+}
+
+void jobs_list() {
+  pthread_mutex_lock(&jobs_lock);
+  if (job_list == NULL) _Log("No background jobs.\n");
+  for (job_t *job = job_list; job; job = job->next) {
+    _Log("[%d] %-7s %s\n", job->id, state_name[job->state], job->title);
+  }
+  pthread_mutex_unlock(&jobs_lock);
+}
+
+/**
+ * Blocks until job id (or every job if id <= 0) has finished, then reports.
+ * Called from the REPL with the db lock held; the lock is released while
+ * waiting so that workers can commit.
+ */
+int jobs_wait(int id) {
+  int ret = 0;
+
+  jobs_unlock_db();
+  pthread_mutex_lock(&jobs_lock);
+  for (;;) {
+    if (id > 0) {
+      job_t *job = job_find(id);
+      if (job == NULL) { ret = -1; break; }
+      if (job_finished(job)) break;
+    } else if (jobs_all_finished()) {
+      break;
+    }
+    pthread_cond_wait(&jobs_cond, &jobs_lock);
+  }
+  pthread_mutex_unlock(&jobs_lock);
+  jobs_lock_db();
+
+  jobs_report();
+  return ret;
+}
@@ -5,11 +5,27 @@
 #include "database.h"
 
 void adb_init();
+void adb_cleanup();
+int  queue_open(const char *path);
+void queue_close();
 
 ass_state_t ass_state = { .state = ASS_STOP };
 
 static char *log_file = NULL;
 static char *db_file = NULL;
+static int json_threads = 1;
+static bool ai_stream = true;
+static bool local_parse = true;
+static char *sched_weights = NULL;
+static char *ai_url = NULL;
+static char *ai_model = NULL;
+static char *ai_key = NULL;
+static char *ai_routes = NULL;
+static char *ai_timeout = NULL;
+static int ai_retries = -1;
+static bool ai_hedge = false;
+static char *ai_budget = NULL;
+static char *prompt_format = NULL;
 static void welcome() {
   Log("Build time: %s, %s", __TIME__, __DATE__);
   _Log("Welcome to Ass-Igned!\n");
@@ -26,6 +42,19 @@ static int parse_args(int argc, char *argv[]) {
   const struct option table[] = {
     {"log"      , required_argument, NULL, 'l'},
     {"database" , required_argument, NULL, 'd'},
+    {"json-threads", required_argument, NULL, 'j'},
+    {"no-stream", no_argument      , NULL, 'S'},
+    {"no-local" , no_argument      , NULL, 'L'},
+    {"sched"    , required_argument, NULL, 's'},
+    {"ai-url"   , required_argument, NULL, 'U'},
+    {"ai-model" , required_argument, NULL, 'M'},
+    {"ai-key"   , required_argument, NULL, 'K'},
+    {"ai-routes", required_argument, NULL, 'r'},
+    {"timeout"  , required_argument, NULL, 'T'},
+    {"retries"  , required_argument, NULL, 'R'},
+    {"hedge"    , no_argument      , NULL, 'H'},
+    {"budget"   , required_argument, NULL, 'B'},
+    {"prompt-format", required_argument, NULL, 'F'},
     {"help"     , no_argument      , NULL, 'h'},
     {0          , 0                , NULL,  0 },
   };
@@ -34,9 +63,35 @@ static int parse_args(int argc, char *argv[]) {
     switch (o) {
       case 'l': log_file = optarg; break;
       case 'd': db_file = optarg; break;
+      case 'j': json_threads = atoi(optarg); break;
+      case 'S': ai_stream = false; break;
+      case 'L': local_parse = false; break;
+      case 's': sched_weights = optarg; break;
+      case 'U': ai_url = optarg; break;
+      case 'M': ai_model = optarg; break;
+      case 'K': ai_key = optarg; break;
+      case 'r': ai_routes = optarg; break;
+      case 'T': ai_timeout = optarg; break;
+      case 'R': ai_retries = atoi(optarg); break;
+      case 'H': ai_hedge = true; break;
+      case 'B': ai_budget = optarg; break;
+      case 'F': prompt_format = optarg; break;
       default:
         printf("Usage: %s [OPTION...] IMAGE [args]\n\n", argv[0]);
         printf("\t-l,--log=FILE           output log to FILE\n");
+        printf("\t--json-threads=N        serialize the task list with N threads\n");
+        printf("\t--no-stream              wait for complete AI answers instead of streaming\n");
+        printf("\t--no-local               send every task add to the AI, skip the local parser\n");
+        printf("\t--sched=P,D,A            'task next' weights: hours per priority level, due date, age\n");
+        printf("\t--ai-url=URL             chat-completions endpoint (env AIC_URL)\n");
+        printf("\t--ai-model=NAME          model name (env AIC_MODEL)\n");
+        printf("\t--ai-key=KEY             API key (env AIC_API_KEY)\n");
+        printf("\t--ai-routes=FILE         model, endpoint and parameters per AI command (env AIC_ROUTES)\n");
+        printf("\t--timeout=C[,T[,S]]      AI connect, total and stall timeouts in ms\n");
+        printf("\t--retries=N              retry transient AI failures up to N times\n");
+        printf("\t--hedge                  duplicate AI requests that are slower than the p95\n");
+        printf("\t--budget=S[,R[,C]]       prompt token budget of 'ai sug', reports and chat history (0: unlimited)\n");
+        printf("\t--prompt-format=FMT      task data in 'ai sug' and report prompts: table (default) or json\n");
         printf("\n");
         exit(0);
     }
@@ -48,8 +103,63 @@ void monitor_init(int argc, char *argv[]) {
   parse_args(argc, argv);
   log_init(log_file);
   adb_init();
+  aic_set_endpoint(ai_url, ai_model, ai_key);
+  aic_load_routes(ai_routes);
   Assert(aic_init() == 0, "AI Client init error.");
+  aic_set_streaming(ai_stream);
+
+  aic_policy_t policy;
+  aic_get_policy(&policy);
+  if (ai_timeout != NULL &&
+      sscanf(ai_timeout, "%ld,%ld,%ld", &policy.connect_timeout_ms, &policy.timeout_ms,
+             &policy.stall_ms) < 1) {
+    Log("Ignoring malformed --timeout '%s', expected CONNECT[,TOTAL[,STALL]]", ai_timeout);
+  }
+  if (ai_retries >= 0) policy.max_retries = ai_retries;
+  policy.hedge = ai_hedge;
+  aic_set_policy(&policy);
+  aic_set_local_parse(local_parse);
+  if (prompt_format != NULL) {
+    if (strcmp(prompt_format, "json") == 0 || strcmp(prompt_format, "table") == 0) {
+      aic_format_e format = prompt_format[0] == 'j' ? AIC_FORMAT_JSON : AIC_FORMAT_TABLE;
+      aic_set_template_format(AIC_CMD_SUGGEST, format);
+      aic_set_template_format(AIC_CMD_REPORT, format);
+    } else {
+      Log("Ignoring unknown --prompt-format '%s', expected table or json", prompt_format);
+    }
+  }
+  if (ai_budget != NULL) {
+    long suggest = 0, report = 0, chat = 0;
+    int n = sscanf(ai_budget, "%ld,%ld,%ld", &suggest, &report, &chat);
+    if (n < 1 || suggest < 0 || report < 0 || chat < 0) {
+      Log("Ignoring malformed --budget '%s', expected SUGGEST[,REPORT[,CHAT]]", ai_budget);
+    } else {
+      aic_set_token_budget(AIC_CMD_SUGGEST, suggest);
+      aic_set_token_budget(AIC_CMD_REPORT, n >= 2 ? report : suggest);
+      if (n == 3) aic_set_token_budget(AIC_CMD_CHAT, chat);
+    }
+  }
   db_init(db_file);
+  if (db_file != NULL) {
+    // The AI response cache lives next to the database
+    char cache_file[1024];
+    snprintf(cache_file, sizeof(cache_file), "%s.aicache", db_file);
+    aic_cache_init(cache_file);
+
+    // So are the commands that could not reach the endpoint
+    char queue_file[1024];
+    snprintf(queue_file, sizeof(queue_file), "%s.aiqueue", db_file);
+    queue_open(queue_file);
+  }
+  db_set_json_threads(json_threads);
+  if (sched_weights != NULL) {
+    db_sched_weights_t w;
+    if (sscanf(sched_weights, "%lf,%lf,%lf", &w.prio_hours, &w.due_weight, &w.age_weight) == 3) {
+      db_set_sched_weights(&w);
+    } else {
+      Log("Ignoring malformed --sched '%s', expected P,D,A", sched_weights);
+    }
+  }
   welcome();
 }
 
@@ -65,9 +175,12 @@ void monitor_cleanup() {
       // fall through
     case ASS_QUIT: log_statistic();
   }
+  adb_cleanup();
   if (db_save_db() != 0)
     Log("Database save error.");
   db_shutdown();
+  // Only now are replayed requests safe to drop from the queue
+  queue_close();
   aic_cleanup();
   log_close();
 }
\ No newline at end of file
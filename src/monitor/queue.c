@@ -0,0 +1,406 @@
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "adb.h"
+#include "cJSON.h"
+
+// Offline queue of AI commands.
+// A command whose request could not reach the endpoint is appended to a log
+// next to the database, one JSON object per line ("cmd" is aic_cmd_name()):
+//   {"seq":3,"cmd":"task add","t":1760000000,"title":"task add ...","prompt":"...","ctx":"..."}
+// A replay thread sends the oldest entry again, backing off while the
+// endpoint stays unreachable, and commits the answer with the command's own
+// finish function. Replayed entries are dropped from the file only at
+// shutdown, after the database has been saved, so a crash replays them once
+// more and the finish functions skip what was already committed.
+
+#define QUEUE_BACKOFF_BASE_MS (2 * 1000)
+#define QUEUE_BACKOFF_MAX_MS  (5 * 60 * 1000)
+
+typedef struct entry {
+  int seq;
+  aic_cmd_e cmd;
+  time_t queued_at;
+  char *title;
+  char *prompt;
+  char *ctx;            // saved by the handler, NULL if none
+  bool done;            // committed (or failed for good) in this session
+  struct entry *next;
+} entry_t;
+
+static queue_handler_t handlers[NR_AIC_CMD];
+
+static FILE *queue_fp = NULL;
+static char *queue_path = NULL;
+static entry_t *entries = NULL;   // oldest first
+static int next_seq = 1;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t replayer;
+static bool replaying = false;
+static bool stopping = false;
+static int failures = 0;          // consecutive replays that found the endpoint down
+static struct timespec next_try;  // CLOCK_REALTIME, for pthread_cond_timedwait
+
+// --- Internal Functions ---
+
+static void entry_free(entry_t *e) {
+  free(e->title);
+  free(e->prompt);
+  free(e->ctx);
+  free(e);
+}
+
+static int cmd_by_name(const char *name) {
+  for (int cmd = 0; cmd < NR_AIC_CMD; cmd ++) {
+    if (strcmp(name, aic_cmd_name(cmd)) == 0) return cmd;
+  }
+  return -1;
+}
+
+static void append_entry(entry_t *e) {
+  entry_t **tail = &entries;
+  while (*tail) tail = &(*tail)->next;
+  *tail = e;
+}
+
+static entry_t *first_pending(void) {
+  for (entry_t *e = entries; e; e = e->next) {
+    if (!e->done) return e;
+  }
+  return NULL;
+}
+
+static char *entry_to_json(const entry_t *e) {
+  cJSON *root = cJSON_CreateObject();
+  if (root == NULL) return NULL;
+  cJSON_AddNumberToObject(root, "seq", e->seq);
+  cJSON_AddStringToObject(root, "cmd", aic_cmd_name(e->cmd));
+  cJSON_AddNumberToObject(root, "t", (double)e->queued_at);
+  cJSON_AddStringToObject(root, "title", e->title);
+  cJSON_AddStringToObject(root, "prompt", e->prompt);
+  if (e->ctx) cJSON_AddStringToObject(root, "ctx", e->ctx);
+  char *json = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+  return json;
+}
+
+static entry_t *entry_from_json(const char *line) {
+  cJSON *root = cJSON_Parse(line);
+  if (root == NULL) return NULL;
+
+  const cJSON *seq = cJSON_GetObjectItemCaseSensitive(root, "seq");
+  const cJSON *cmd = cJSON_GetObjectItemCaseSensitive(root, "cmd");
+  const cJSON *t = cJSON_GetObjectItemCaseSensitive(root, "t");
+  const cJSON *title = cJSON_GetObjectItemCaseSensitive(root, "title");
+  const cJSON *prompt = cJSON_GetObjectItemCaseSensitive(root, "prompt");
+  const cJSON *ctx = cJSON_GetObjectItemCaseSensitive(root, "ctx");
+  entry_t *e = NULL;
+
+  if (cJSON_IsNumber(seq) && cJSON_IsString(cmd) && cJSON_IsNumber(t) &&
+      cJSON_IsString(title) && cJSON_IsString(prompt) && (ctx == NULL || cJSON_IsString(ctx)) &&
+      cmd_by_name(cmd->valuestring) >= 0) {
+    e = calloc(1, sizeof(entry_t));
+    if (!e) panic("Memory allocation failed for queue entry.");
+    e->seq = seq->valueint;
+    e->cmd = cmd_by_name(cmd->valuestring);
+    e->queued_at = (time_t)t->valuedouble;
+    e->title = strdup(title->valuestring);
+    e->prompt = strdup(prompt->valuestring);
+    e->ctx = ctx ? strdup(ctx->valuestring) : NULL;
+    if (!e->title || !e->prompt || (ctx && !e->ctx)) panic("Memory allocation failed for queue entry.");
+  }
+  cJSON_Delete(root);
+  return e;
+}
+
+// Writes one line and forces it to disk; the command is lost otherwise
+static int write_entry(FILE *fp, const entry_t *e) {
+  char *json = entry_to_json(e);
+  if (json == NULL) return -1;
+  int ret = (fprintf(fp, "%s\n", json) < 0 || fflush(fp) != 0 || fsync(fileno(fp)) != 0) ? -1 : 0;
+  free(json);
+  return ret;
+}
+
+// Exponential backoff with full jitter, counted in consecutive failures
+static void schedule_retry(void) {
+  long cap = QUEUE_BACKOFF_BASE_MS;
+  for (int i = 1; i < failures && cap < QUEUE_BACKOFF_MAX_MS; i ++) cap *= 2;
+  if (cap > QUEUE_BACKOFF_MAX_MS) cap = QUEUE_BACKOFF_MAX_MS;
+  long delay = cap / 2 + rand() % (cap / 2 + 1);
+
+  clock_gettime(CLOCK_REALTIME, &next_try);
+  next_try.tv_sec += delay / 1000;
+  next_try.tv_nsec += (delay % 1000) * 1000000L;
+  if (next_try.tv_nsec >= 1000000000L) {
+    next_try.tv_sec ++;
+    next_try.tv_nsec -= 1000000000L;
+  }
+}
+
+static bool retry_due(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return now.tv_sec > next_try.tv_sec ||
+         (now.tv_sec == next_try.tv_sec && now.tv_nsec >= next_try.tv_nsec);
+}
+
+// Sends e again; returns false if the endpoint is still unreachable
+static bool replay(entry_t *e) {
+  const queue_handler_t *h = &handlers[e->cmd];
+  job_t *job = calloc(1, sizeof(job_t));
+  if (!job) panic("Memory allocation failed for job.");
+  job->cmd = e->cmd;
+  job->queued_at = e->queued_at;
+  job->background = true;
+  job->finish = h->finish;
+
+  char *prompt = strdup(e->prompt);
+  if (!prompt) panic("Memory allocation failed for queue entry.");
+  job->prompt = aic_prompt_wrap(prompt);
+
+  char *result = aic_call_prompt(e->cmd, job->prompt, NULL, NULL);
+  if (result == NULL && aic_last_error() == AIC_ERR_NETWORK) {
+    aic_prompt_free(job->prompt);
+    free(job);
+    return false;
+  }
+
+  job->title = strdup(e->title);
+  if (!job->title) panic("Memory allocation failed for job.");
+  job->ctx = (e->ctx && h->load_ctx) ? h->load_ctx(e->ctx) : NULL;
+  int ret = -1;
+
+  jobs_lock_db();
+  if (result == NULL) {
+    job_printf(job, "Queued AI request #%d failed.\n", e->seq);
+  } else if (e->ctx && h->load_ctx && job->ctx == NULL) {
+    job_printf(job, "Queued AI request #%d has unreadable data, dropped.\n", e->seq);
+  } else {
+    ret = job->finish(job, result);
+  }
+  jobs_unlock_db();
+  free(result);
+
+  jobs_adopt(job, ret == 0 ? JOB_DONE : JOB_FAILED);
+  return true;
+}
+
+static void *replay_worker(void *arg) {
+  pthread_mutex_lock(&queue_lock);
+  while (!stopping) {
+    entry_t *e = first_pending();
+    if (e == NULL) {
+      pthread_cond_wait(&queue_cond, &queue_lock);
+      continue;
+    }
+    if (failures > 0 && !retry_due()) {
+      pthread_cond_timedwait(&queue_cond, &queue_lock, &next_try);
+      continue;
+    }
+
+    pthread_mutex_unlock(&queue_lock);
+    bool sent = replay(e);
+    pthread_mutex_lock(&queue_lock);
+
+    if (sent) {
+      e->done = true;
+      failures = 0;
+      log_write("[queue] replayed #%d\n", e->seq);
+    } else {
+      failures ++;
+      schedule_retry();
+      log_write("[queue] endpoint still unreachable, retrying #%d in %lds\n", e->seq,
+          (long)(next_try.tv_sec - time(NULL)));
+    }
+  }
+  pthread_mutex_unlock(&queue_lock);
+  return NULL;
+}
+
+// --- Public Functions ---
+
+void queue_register(aic_cmd_e cmd, const queue_handler_t *handler) {
+  handlers[cmd] = *handler;
+}
+
+int queue_open(const char *path) {
+  queue_fp = fopen(path, "a+");
+  if (queue_fp == NULL) {
+    Log("WARN: Can't open AI request queue '%s', offline commands are not kept.", path);
+    return -1;
+  }
+  queue_path = strdup(path);
+  if (!queue_path) panic("Memory allocation failed for queue path.");
+
+  // A torn line (crash while appending) is skipped
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  bool torn = false;
+  int nr_pending = 0, nr_bad = 0;
+  fseek(queue_fp, 0, SEEK_SET);
+  while ((len = getline(&line, &cap, queue_fp)) != -1) {
+    torn = line[len - 1] != '\n';
+    if (strspn(line, " \t\r\n") == strlen(line)) continue;
+    entry_t *e = entry_from_json(line);
+    if (e == NULL || handlers[e->cmd].finish == NULL) {
+      if (e) entry_free(e);
+      nr_bad ++;
+      continue;
+    }
+    if (e->seq >= next_seq) next_seq = e->seq + 1;
+    append_entry(e);
+    nr_pending ++;
+  }
+  free(line);
+  fseek(queue_fp, 0, SEEK_END);
+  // Appends must not continue the torn line
+  if (torn) fputc('\n', queue_fp);
+
+  if (nr_bad > 0) Log("WARN: Skipped %d unreadable entries of AI request queue '%s'.", nr_bad, path);
+  if (nr_pending > 0) Log("%d queued AI requests from an earlier session, replaying.", nr_pending);
+
+  if (pthread_create(&replayer, NULL, replay_worker, NULL) != 0) {
+    Log("WARN: Failed to start the queue replay thread, queued requests wait for the next start.");
+  } else {
+    replaying = true;
+  }
+  return 0;
+}
+
+bool queue_accepts(aic_cmd_e cmd) {
+  return queue_fp != NULL && handlers[cmd].finish != NULL;
+}
+
+bool queue_offline() {
+  pthread_mutex_lock(&queue_lock);
+  bool offline = failures > 0 && first_pending() != NULL;
+  pthread_mutex_unlock(&queue_lock);
+  return offline;
+}
+
+/**
+ * Appends the job's request to the queue (on disk before returning) and
+ * wakes the replay thread. The job itself stays with the caller.
+ * @return The entry's number, or -1 if it could not be written.
+ */
+int queue_push(const job_t *job) {
+  const queue_handler_t *h = &handlers[job->cmd];
+  entry_t *e = calloc(1, sizeof(entry_t));
+  if (!e) panic("Memory allocation failed for queue entry.");
+  e->cmd = job->cmd;
+  e->queued_at = job->queued_at ? job->queued_at : time(NULL);
+  e->title = strdup(job->title ? job->title : aic_cmd_name(job->cmd));
+  e->prompt = aic_prompt_flatten(job->prompt);
+  e->ctx = (job->ctx && h->save_ctx) ? h->save_ctx(job->ctx) : NULL;
+  if (!e->title || !e->prompt) panic("Memory allocation failed for queue entry.");
+
+  pthread_mutex_lock(&queue_lock);
+  e->seq = next_seq;
+  if (write_entry(queue_fp, e) != 0) {
+    pthread_mutex_unlock(&queue_lock);
+    Log("ERROR: Failed to write AI request queue '%s'.", queue_path);
+    entry_free(e);
+    return -1;
+  }
+  next_seq ++;
+  append_entry(e);
+  // The endpoint was just found unreachable: give it a moment
+  if (failures == 0) {
+    failures = 1;
+    schedule_retry();
+  }
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_lock);
+  return e->seq;
+}
+
+void queue_list() {
+  time_t now = time(NULL);
+  int nr_pending = 0;
+
+  pthread_mutex_lock(&queue_lock);
+  for (entry_t *e = entries; e; e = e->next) {
+    if (e->done) continue;
+    _Log("#%-4d %6lds ago  %s\n", e->seq, (long)(now - e->queued_at), e->title);
+    nr_pending ++;
+  }
+  if (queue_fp == NULL) {
+    _Log("No AI request queue (start with a database file to keep offline commands).\n");
+  } else if (nr_pending == 0) {
+    _Log("No queued AI requests.\n");
+  } else if (failures > 0) {
+    long wait = next_try.tv_sec - now;
+    _Log("Endpoint unreachable %d times in a row, next try in %lds.\n", failures, wait > 0 ? wait : 0);
+  }
+  pthread_mutex_unlock(&queue_lock);
+}
+
+// Retries the oldest entry now instead of waiting for the backoff
+void queue_retry() {
+  pthread_mutex_lock(&queue_lock);
+  clock_gettime(CLOCK_REALTIME, &next_try);
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_lock);
+}
+
+// Stops replaying; waits for a request already on the wire
+void queue_stop() {
+  if (!replaying) return;
+  pthread_mutex_lock(&queue_lock);
+  stopping = true;
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_lock);
+  pthread_join(replayer, NULL);
+  replaying = false;
+}
+
+/**
+ * Rewrites the queue with the entries still pending, or removes it when none
+ * are left. Call after the database has been saved: a replayed entry must
+ * not be forgotten before its result is on disk.
+ */
+void queue_close() {
+  if (queue_fp == NULL) return;
+  queue_stop();
+  fclose(queue_fp);
+  queue_fp = NULL;
+
+  size_t tmp_len = strlen(queue_path) + 5;
+  char *tmp_path = malloc(tmp_len);
+  if (!tmp_path) panic("Memory allocation failed for queue path.");
+  snprintf(tmp_path, tmp_len, "%s.tmp", queue_path);
+
+  int nr_pending = 0;
+  bool ok = true;
+  FILE *out = NULL;
+  for (entry_t *e = entries; e && ok; e = e->next) {
+    if (e->done) continue;
+    if (out == NULL && (out = fopen(tmp_path, "w")) == NULL) ok = false;
+    else if (write_entry(out, e) != 0) ok = false;
+    else nr_pending ++;
+  }
+  if (out && fclose(out) != 0) ok = false;
+
+  if (nr_pending == 0 && ok) {
+    remove(queue_path);
+  } else if (!ok || rename(tmp_path, queue_path) != 0) {
+    // The old file still holds every pending entry (and some replayed ones)
+    Log("WARN: Failed to rewrite AI request queue '%s', replayed entries are kept.", queue_path);
+    remove(tmp_path);
+  } else {
+    Log("%d AI requests still queued, they are replayed on the next start.", nr_pending);
+  }
+
+  while (entries) {
+    entry_t *e = entries;
+    entries = e->next;
+    entry_free(e);
+  }
+  SAFE_FREE(queue_path);
+  free(tmp_path);
+}
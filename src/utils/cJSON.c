@@ -185,6 +185,8 @@ static void * CJSON_CDECL internal_realloc(void *pointer, size_t size)
 
 static internal_hooks global_hooks = { internal_malloc, internal_free, internal_realloc };
 
+static void invalidate_key_index(cJSON * const object);
+
 static unsigned char* cJSON_strdup(const unsigned char* string, const internal_hooks * const hooks)
 {
     size_t length = 0;
@@ -260,6 +262,7 @@ CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
         {
             cJSON_Delete(item->child);
         }
+        invalidate_key_index(item);
         if (!(item->type & cJSON_IsReference) && (item->valuestring != NULL))
         {
             global_hooks.deallocate(item->valuestring);
@@ -587,6 +590,66 @@ static cJSON_bool compare_double(double a, double b)
     return (fabs(a - b) <= maxVal * DBL_EPSILON);
 }
 
+/* two ASCII digits for every value in 0..99 */
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* largest magnitude below which every integer is exactly representable as a double (2^53) */
+#define CJSON_EXACT_INTEGER_LIMIT 9007199254740992.0
+
+/* Prints an integral double without going through sprintf.
+ * The caller guarantees that |number| < CJSON_EXACT_INTEGER_LIMIT. */
+static int print_integer(unsigned char * const buffer, double number)
+{
+    unsigned char digits[20];
+    unsigned char *digit = digits + sizeof(digits);
+    unsigned long long magnitude = 0;
+    int length = 0;
+
+    if (number < 0)
+    {
+        buffer[length++] = '-';
+        magnitude = (unsigned long long)(-number);
+    }
+    else
+    {
+        magnitude = (unsigned long long)number;
+    }
+
+    while (magnitude >= 100)
+    {
+        size_t pair = (size_t)(magnitude % 100) * 2;
+        magnitude /= 100;
+        *--digit = (unsigned char)digit_pairs[pair + 1];
+        *--digit = (unsigned char)digit_pairs[pair];
+    }
+    if (magnitude >= 10)
+    {
+        size_t pair = (size_t)magnitude * 2;
+        *--digit = (unsigned char)digit_pairs[pair + 1];
+        *--digit = (unsigned char)digit_pairs[pair];
+    }
+    else
+    {
+        *--digit = (unsigned char)('0' + magnitude);
+    }
+
+    memcpy(buffer + length, digit, (size_t)(digits + sizeof(digits) - digit));
+    length += (int)(digits + sizeof(digits) - digit);
+    buffer[length] = '\0';
+
+    return length;
+}
+
 /* Render the number nicely from the given item into a string. */
 static cJSON_bool print_number(const cJSON * const item, printbuffer * const output_buffer)
 {
@@ -597,6 +660,7 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
     unsigned char number_buffer[26] = {0}; /* temporary buffer to print the number into */
     unsigned char decimal_point = get_decimal_point();
     double test = 0.0;
+    char *test_end = NULL;
 
     if (output_buffer == NULL)
     {
@@ -608,17 +672,20 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
     {
         length = sprintf((char*)number_buffer, "null");
     }
-    else if(d == (double)item->valueint)
+    else if ((d == floor(d)) && (fabs(d) < CJSON_EXACT_INTEGER_LIMIT))
     {
-        length = sprintf((char*)number_buffer, "%d", item->valueint);
+        /* ids, enums and timestamps: exact integers need no float formatting */
+        length = print_integer(number_buffer, d);
     }
     else
     {
         /* Try 15 decimal places of precision to avoid nonsignificant nonzero digits */
         length = sprintf((char*)number_buffer, "%1.15g", d);
 
-        /* Check whether the original double can be recovered */
-        if ((sscanf((char*)number_buffer, "%lg", &test) != 1) || !compare_double((double)test, d))
+        /* Check whether the original double can be recovered.
+         * sprintf and strtod both use the current locale; only the output below is normalised to '.' */
+        test = strtod((const char*)number_buffer, &test_end);
+        if ((test_end == (char*)number_buffer) || !compare_double(test, d))
         {
             /* If not, print with 17 decimal places of precision */
             length = sprintf((char*)number_buffer, "%1.17g", d);
@@ -1079,6 +1146,7 @@ static cJSON_bool print_value(const cJSON * const item, printbuffer * const outp
 static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buffer);
 static cJSON_bool print_array(const cJSON * const item, printbuffer * const output_buffer);
 static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_buffer);
+static struct cJSON_KeyIndex *build_key_index(cJSON * const object);
 static cJSON_bool print_object(const cJSON * const item, printbuffer * const output_buffer);
 
 /* Utility to jump whitespace and cr/lf */
@@ -1754,6 +1822,12 @@ success:
     item->type = cJSON_Object;
     item->child = head;
 
+    /* built here, while the object is private to the parser, so lookups never write to it */
+    if (CJSON_KEY_INDEX_MIN_ITEMS > 0)
+    {
+        build_key_index(item);
+    }
+
     input_buffer->offset++;
     return true;
 
@@ -1933,6 +2007,113 @@ CJSON_PUBLIC(cJSON *) cJSON_GetArrayItem(const cJSON *array, int index)
     return get_array_item(array, (size_t)index);
 }
 
+/* Open addressing hash table over the children of an object.
+ * Keys are hashed case-folded so the same table serves both lookup flavours,
+ * and slots are filled in list order so the first duplicate key still wins. */
+typedef struct
+{
+    unsigned long hash;
+    cJSON *item;
+} key_index_slot;
+
+struct cJSON_KeyIndex
+{
+    const cJSON *head; /* object->child at build time, used to detect foreign list edits */
+    size_t mask;
+    key_index_slot *slots;
+};
+
+static unsigned long hash_key(const unsigned char *string)
+{
+    /* FNV-1a over the ASCII-lowercased key */
+    unsigned long hash = 2166136261UL;
+    for (; *string != '\0'; string++)
+    {
+        hash ^= (unsigned long)tolower(*string);
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+static void free_key_index(cJSON * const object)
+{
+    if (object->keyindex != NULL)
+    {
+        global_hooks.deallocate(object->keyindex->slots);
+        global_hooks.deallocate(object->keyindex);
+        object->keyindex = NULL;
+    }
+}
+
+/* Called by every function that edits the child list of an array or object. */
+static void invalidate_key_index(cJSON * const object)
+{
+    if ((object != NULL) && !(object->type & cJSON_IsReference))
+    {
+        free_key_index(object);
+    }
+}
+
+static struct cJSON_KeyIndex *build_key_index(cJSON * const object)
+{
+    struct cJSON_KeyIndex *index = NULL;
+    cJSON *current_element = NULL;
+    size_t count = 0;
+    size_t capacity = 16;
+
+    for (current_element = object->child; current_element != NULL; current_element = current_element->next)
+    {
+        if (current_element->string == NULL)
+        {
+            /* malformed object, keep the linear search semantics */
+            return NULL;
+        }
+        count++;
+    }
+
+    if (count < CJSON_KEY_INDEX_MIN_ITEMS)
+    {
+        return NULL;
+    }
+
+    /* keep the load factor at or below one half */
+    while (capacity < (count * 2))
+    {
+        capacity *= 2;
+    }
+
+    index = (struct cJSON_KeyIndex*)global_hooks.allocate(sizeof(struct cJSON_KeyIndex));
+    if (index == NULL)
+    {
+        return NULL;
+    }
+    index->slots = (key_index_slot*)global_hooks.allocate(capacity * sizeof(key_index_slot));
+    if (index->slots == NULL)
+    {
+        global_hooks.deallocate(index);
+        return NULL;
+    }
+    memset(index->slots, '\0', capacity * sizeof(key_index_slot));
+    index->head = object->child;
+    index->mask = capacity - 1;
+
+    for (current_element = object->child; current_element != NULL; current_element = current_element->next)
+    {
+        unsigned long hash = hash_key((const unsigned char*)current_element->string);
+        size_t position = (size_t)hash & index->mask;
+        while (index->slots[position].item != NULL)
+        {
+            position = (position + 1) & index->mask;
+        }
+        index->slots[position].hash = hash;
+        index->slots[position].item = current_element;
+    }
+
+    object->keyindex = index;
+    return index;
+}
+
 static cJSON *get_object_item(const cJSON * const object, const char * const name, const cJSON_bool case_sensitive)
 {
     cJSON *current_element = NULL;
@@ -1942,6 +2123,34 @@ static cJSON *get_object_item(const cJSON * const object, const char * const nam
         return NULL;
     }
 
+    if ((CJSON_KEY_INDEX_MIN_ITEMS > 0) && (object->type & 0xFF) == cJSON_Object && !(object->type & cJSON_IsReference))
+    {
+        /* Lookups only read the index: it is built by the parser and dropped by edits.
+         * A stale one (the child list was relinked by hand) is ignored, not rebuilt. */
+        const struct cJSON_KeyIndex *index = object->keyindex;
+
+        if ((index != NULL) && (index->head == object->child))
+        {
+            unsigned long hash = hash_key((const unsigned char*)name);
+            size_t position = (size_t)hash & index->mask;
+            for (; index->slots[position].item != NULL; position = (position + 1) & index->mask)
+            {
+                current_element = index->slots[position].item;
+                if (index->slots[position].hash != hash)
+                {
+                    continue;
+                }
+                if (case_sensitive ? (strcmp(name, current_element->string) == 0)
+                                   : (case_insensitive_strcmp((const unsigned char*)name, (const unsigned char*)current_element->string) == 0))
+                {
+                    return current_element;
+                }
+            }
+
+            return NULL;
+        }
+    }
+
     current_element = object->child;
     if (case_sensitive)
     {
@@ -2004,6 +2213,7 @@ static cJSON *create_reference(const cJSON *item, const internal_hooks * const h
 
     memcpy(reference, item, sizeof(cJSON));
     reference->string = NULL;
+    reference->keyindex = NULL;
     reference->type |= cJSON_IsReference;
     reference->next = reference->prev = NULL;
     return reference;
@@ -2018,6 +2228,7 @@ static cJSON_bool add_item_to_array(cJSON *array, cJSON *item)
         return false;
     }
 
+    invalidate_key_index(array);
     child = array->child;
     /*
      * To find the last item in array quickly, we use prev in array
@@ -2247,6 +2458,7 @@ CJSON_PUBLIC(cJSON *) cJSON_DetachItemViaPointer(cJSON *parent, cJSON * const it
         return NULL;
     }
 
+    invalidate_key_index(parent);
     if (item != parent->child)
     {
         /* not the first element */
@@ -2336,6 +2548,7 @@ CJSON_PUBLIC(cJSON_bool) cJSON_InsertItemInArray(cJSON *array, int which, cJSON
         return false;
     }
 
+    invalidate_key_index(array);
     newitem->next = after_inserted;
     newitem->prev = after_inserted->prev;
     after_inserted->prev = newitem;
@@ -2362,6 +2575,7 @@ CJSON_PUBLIC(cJSON_bool) cJSON_ReplaceItemViaPointer(cJSON * const parent, cJSON
         return true;
     }
 
+    invalidate_key_index(parent);
     replacement->next = item->next;
     replacement->prev = item->prev;
 
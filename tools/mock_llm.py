@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+"""Stand-in chat-completions server for offline testing and benchmarking.
+
+Speaks enough of the OpenAI/DeepSeek chat-completions protocol for ai_client:
+plain JSON answers, or server-sent events when the request has "stream": true.
+Task-add, task-multi and task-update prompts get canned task JSON (multi: one
+task per comma- or semicolon-separated clause), everything else a short text
+answer, so every adb command works without network access.
+
+Behaviour is scripted with command-line flags (apply to every request), a
+replies file, or directives embedded in the user message, e.g.
+
+    ai chat hello [[mock latency=800 status=503]]
+
+Directives: latency=MS, chunk=CHARS, delay=MS (between chunks), status=CODE,
+reply=TEXT (rest of the directive, may contain spaces).
+
+The replies file is a JSON list of rules tried in order, first match wins:
+
+    [{"match": "周报", "reply": {"title": "周报", "prio": 1}, "latency": 200},
+     {"match": "fail", "status": 500}]
+
+"match" is a regular expression searched in the last user message; "reply" is
+a string or a JSON value (sent serialized).
+
+Like DeepSeek's context cache, the mock remembers request prefixes (64-token
+blocks of the serialized messages) and reports prompt_cache_hit_tokens /
+prompt_cache_miss_tokens in "usage"; --prefill adds latency per uncached token.
+
+Usage: python3 tools/mock_llm.py [--port 18080] [--latency MS] [--jitter MS]
+       [--tail-rate P] [--tail-latency MS] [--chunk CHARS] [--delay MS]
+       [--error-rate P] [--error-status CODE] [--replies FILE] [--seed N]
+       [--prefill MS_PER_1K_TOKENS]
+"""
+
+import argparse
+import http.server
+import json
+import random
+import re
+import sys
+import threading
+import time
+
+DIRECTIVE = re.compile(r"\[\[mock\s+([^\]]*)\]\]")
+
+args = None
+rules = []
+rng = random.Random()
+rng_lock = threading.Lock()
+
+CACHE_BLOCK = 64 * 4   # characters per cached block (64 tokens at ~4 chars each)
+prefixes = set()
+prefix_lock = threading.Lock()
+
+
+def parse_directives(text):
+    opts = {}
+    for m in DIRECTIVE.finditer(text):
+        body = m.group(1)
+        reply = re.search(r"\breply=(.*)$", body)
+        if reply:
+            opts["reply"] = reply.group(1).strip()
+            body = body[:reply.start()]
+        for key, value in re.findall(r"(\w+)=(\S+)", body):
+            opts[key] = value
+    return opts, DIRECTIVE.sub("", text).strip()
+
+
+def canned_answer(prompt, user):
+    now = int(time.time())
+    if "### Task to Parse" in prompt:
+        task = user.rsplit("### Task to Parse", 1)[-1]
+        task = task.split("### Expected Output", 1)[0].strip()
+        return json.dumps({
+            "title": task[:120] or "mock task",
+            "description": "",
+            "due_date": now + 7 * 24 * 3600,
+            "prio": 2,
+        }, ensure_ascii=False)
+    if "### Tasks to Parse" in prompt:
+        text = user.rsplit("### Tasks to Parse", 1)[-1]
+        text = text.split("### Expected Output", 1)[0].strip()
+        clauses = [c.strip() for c in re.split(r"[，,；;、\n]", text) if c.strip()]
+        return json.dumps([{
+            "title": c[:120],
+            "description": "",
+            "due_date": now + 7 * 24 * 3600,
+            "prio": 2,
+        } for c in clauses or ["mock task"]], ensure_ascii=False)
+    if "### Current Task State (JSON)" in prompt:
+        state = prompt.split("### Current Task State (JSON)", 1)[1]
+        state = state.split("### Update Instruction", 1)[0].strip()
+        try:
+            return json.dumps(json.loads(state), ensure_ascii=False)
+        except ValueError:
+            return state
+    return "mock reply: received %d characters." % len(prompt)
+
+
+def pick_rule(user):
+    for rule in rules:
+        if re.search(rule.get("match", ""), user):
+            return rule
+    return {}
+
+
+def cached_prefix(messages):
+    """Characters of the request already seen as a prefix; remembers this one."""
+    data = json.dumps(messages, ensure_ascii=False)
+    hit = 0
+    with prefix_lock:
+        for end in range(CACHE_BLOCK, len(data) + 1, CACHE_BLOCK):
+            key = hash(data[:end])
+            if key not in prefixes:
+                prefixes.add(key)
+                continue
+            hit = end
+    return hit
+
+
+def usage(prompt, text, hit_chars):
+    # Rough token counts so clients that log usage have something to show
+    prompt_tokens = max(1, len(prompt) // 4)
+    hit = min(hit_chars // 4, prompt_tokens)
+    return {
+        "prompt_tokens": prompt_tokens,
+        "completion_tokens": max(1, len(text) // 4),
+        "total_tokens": prompt_tokens + max(1, len(text) // 4),
+        "prompt_cache_hit_tokens": hit,
+        "prompt_cache_miss_tokens": prompt_tokens - hit,
+    }
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def handle(self):
+        try:
+            super().handle()
+        except (BrokenPipeError, ConnectionResetError):
+            pass  # the client gave up (timeout, or a hedged duplicate lost)
+
+    def send_json(self, status, obj):
+        out = json.dumps(obj, ensure_ascii=False).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(out)))
+        self.end_headers()
+        self.wfile.write(out)
+
+    def send_chunk(self, data):
+        self.wfile.write(b"%x\r\n" % len(data) + data + b"\r\n")
+        self.wfile.flush()
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", 0))
+        try:
+            body = json.loads(self.rfile.read(length) or b"{}")
+        except ValueError:
+            self.send_json(400, {"error": {"message": "invalid JSON body"}})
+            return
+
+        messages = body.get("messages") or [{}]
+        prompt = "\n".join(str(m.get("content", "")) for m in messages)
+        opts, user = parse_directives(str(messages[-1].get("content", "")))
+        rule = pick_rule(user)
+        hit_chars = cached_prefix(messages)
+
+        latency = float(opts.get("latency", rule.get("latency", args.latency)))
+        with rng_lock:
+            latency += rng.uniform(0, args.jitter)
+            if rng.random() < args.tail_rate:
+                latency += args.tail_latency
+            fail = rng.random() < args.error_rate
+        status = int(opts.get("status", rule.get("status", args.error_status if fail else 200)))
+        chunk = max(1, int(opts.get("chunk", rule.get("chunk", args.chunk))))
+        delay = float(opts.get("delay", rule.get("delay", args.delay)))
+        latency += args.prefill * max(0, len(prompt) - hit_chars) / 4 / 1000.0
+
+        time.sleep(latency / 1000.0)
+
+        if status != 200:
+            self.send_json(status, {"error": {"message": "mock error", "code": status}})
+            return
+
+        if "reply" in opts:
+            text = opts["reply"]
+        elif "reply" in rule:
+            reply = rule["reply"]
+            text = reply if isinstance(reply, str) else json.dumps(reply, ensure_ascii=False)
+        else:
+            text = canned_answer(prompt, user)
+
+        model = body.get("model", "mock")
+        if not body.get("stream"):
+            self.send_json(200, {
+                "model": model,
+                "choices": [{"index": 0, "message": {"role": "assistant", "content": text},
+                             "finish_reason": "stop"}],
+                "usage": usage(prompt, text, hit_chars),
+            })
+            return
+
+        self.send_response(200)
+        self.send_header("Content-Type", "text/event-stream")
+        self.send_header("Transfer-Encoding", "chunked")
+        self.end_headers()
+        for i in range(0, len(text), chunk):
+            event = {"model": model, "choices": [{"index": 0, "delta": {"content": text[i:i + chunk]}}]}
+            self.send_chunk(("data: " + json.dumps(event, ensure_ascii=False) + "\n\n").encode())
+            time.sleep(delay / 1000.0)
+        final = {"model": model, "choices": [{"index": 0, "delta": {}, "finish_reason": "stop"}],
+                 "usage": usage(prompt, text, hit_chars)}
+        self.send_chunk(("data: " + json.dumps(final) + "\n\n").encode())
+        self.send_chunk(b"data: [DONE]\n\n")
+        self.wfile.write(b"0\r\n\r\n")
+        self.wfile.flush()
+
+    def log_message(self, fmt, *a):
+        if args.verbose:
+            sys.stderr.write("mock: " + fmt % a + "\n")
+
+
+def main():
+    global args, rules
+    parser = argparse.ArgumentParser(description="Mock chat-completions server")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=18080)
+    parser.add_argument("--latency", type=float, default=0, help="ms before the answer")
+    parser.add_argument("--jitter", type=float, default=0, help="random extra latency, ms")
+    parser.add_argument("--tail-rate", type=float, default=0, help="fraction of slow requests")
+    parser.add_argument("--tail-latency", type=float, default=2000, help="extra ms of a slow request")
+    parser.add_argument("--chunk", type=int, default=4, help="characters per streamed event")
+    parser.add_argument("--delay", type=float, default=10, help="ms between streamed events")
+    parser.add_argument("--error-rate", type=float, default=0, help="fraction of requests that fail")
+    parser.add_argument("--error-status", type=int, default=503)
+    parser.add_argument("--replies", help="JSON file with scripted replies")
+    parser.add_argument("--seed", type=int)
+    parser.add_argument("--prefill", type=float, default=0,
+                        help="ms of latency per 1000 prompt tokens not served from the prefix cache")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+
+    if args.replies:
+        with open(args.replies, encoding="utf-8") as f:
+            rules = json.load(f)
+    if args.seed is not None:
+        rng.seed(args.seed)
+
+    server = http.server.ThreadingHTTPServer((args.host, args.port), Handler)
+    server.daemon_threads = True
+    print("mock LLM listening on http://%s:%d/chat/completions" % (args.host, args.port), flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()